@@ -1,6 +1,58 @@
 #include <vulkan/vulkan.h>
 #include <stdbool.h>
-#define SUPPORTED_RADIX_LEVELS 3
+#define SUPPORTED_RADIX_COUNT 6
+#define SHARED_MEMORY_MAX_STAGES 16
+#define MAX_STAGE_COUNT 32
+#define VULKAN_FFT_SPECIALIZATION_CONSTANT_COUNT 8
+#define VULKAN_FFT_STAGING_BUFFER_COUNT 4
+#define VULKAN_FFT_VISUALIZE_REAL 0
+#define VULKAN_FFT_VISUALIZE_MAGNITUDE 1
+#define VULKAN_FFT_VISUALIZE_LOG_MAGNITUDE 2
+#define VULKAN_FFT_VISUALIZE_PHASE 3
+
+typedef struct {
+    uint32_t sampleCount, referenceCount;
+    VkBuffer buffer;
+} VulkanFFTTwiddleFactors;
+
+typedef struct {
+    VkBuffer buffer;
+    VkDeviceSize offset, size;
+} VulkanFFTMemoryRange;
+
+typedef struct {
+    VkDeviceMemory deviceMemory;
+    uint32_t memoryTypeIndex;
+    VkDeviceSize size;
+    bool scratch;
+    uint32_t rangeCount;
+    VulkanFFTMemoryRange* ranges;
+} VulkanFFTMemoryBlock;
+
+typedef struct {
+    VkShaderModule shaderModule;
+    uint32_t specializationData[VULKAN_FFT_SPECIALIZATION_CONSTANT_COUNT], referenceCount;
+    VkPipeline pipeline;
+} VulkanFFTPipeline;
+
+typedef struct {
+    VkDeviceSize size;
+    VkBuffer buffer;
+    VkDeviceMemory deviceMemory;
+    void* map;
+    VkFence fence;
+    bool inUse, pending;
+    VkCommandBuffer commandBuffer;
+    VkBuffer recordedDeviceBuffer;
+    VkDeviceSize recordedSize;
+    bool recordedDownload;
+} VulkanFFTStagingBuffer;
+
+typedef struct {
+    uint32_t axis, sampleCount, rowCount[2], maxRadix;
+    bool inPlace, sharedMemory;
+    uint32_t workGroupSize, stageCount, stageRadix[MAX_STAGE_COUNT];
+} VulkanFFTWisdom;
 
 typedef struct {
     VkAllocationCallbacks* allocator;
@@ -11,50 +63,228 @@ typedef struct {
     VkQueue queue;
     VkCommandPool commandPool;
     VkFence fence;
-    VkShaderModule shaderModules[SUPPORTED_RADIX_LEVELS];
-    VkDeviceSize uboAlignment;
+    VkShaderModule shaderModules[SUPPORTED_RADIX_COUNT];
+    VkShaderModule sharedMemoryShaderModule;
+    VkShaderModule bluesteinShaderModule;
+    VkShaderModule realTransformShaderModule;
+    VkShaderModule pointwiseShaderModule;
+    VkShaderModule visualizeShaderModule;
+    uint32_t twiddleFactorsCount;
+    VulkanFFTTwiddleFactors* twiddleFactors;
+    const char* wisdomFileName;
+    uint32_t wisdomCount;
+    VulkanFFTWisdom* wisdom;
+    const char* pipelineCacheFileName;
+    VkPipelineCache pipelineCache;
+    VkDescriptorSetLayout descriptorSetLayouts[2];
+    VkPipelineLayout pipelineLayout;
+    uint32_t pipelinesCount;
+    VulkanFFTPipeline* pipelines;
+    // The ring starts with VULKAN_FFT_STAGING_BUFFER_COUNT entries and grows when all of them are held by transfers,
+    // every entry is allocated separately so that transfers keep valid pointers
+    uint32_t nextStagingBuffer, stagingBufferCount;
+    VulkanFFTStagingBuffer** stagingBuffers;
+    VkDeviceSize memoryBlockSize;
+    uint32_t memoryBlockCount;
+    VulkanFFTMemoryBlock* memoryBlocks;
+    // Measured by the first preferVulkanFFTOnHost (zero before): Round trip of an empty submission in nanoseconds and the throughput of the host engine in GFLOP/s
+    double submitTime, hostGigaFlopsPerSecond;
 } VulkanFFTContext;
 
 void initVulkanFFTContext(VulkanFFTContext* context);
 void freeVulkanFFTContext(VulkanFFTContext* context);
+void loadVulkanFFTWisdom(VulkanFFTContext* context);
+void saveVulkanFFTWisdom(VulkanFFTContext* context);
+void saveVulkanFFTPipelineCache(VulkanFFTContext* context);
 
 typedef struct {
     VulkanFFTContext* context;
     VkDeviceSize size;
-    VkBuffer hostBuffer, deviceBuffer;
-    VkDeviceMemory deviceMemory;
+    VkBuffer deviceBuffer;
+    bool download, submitted;
+    VulkanFFTStagingBuffer* stagingBuffer;
 } VulkanFFTTransfer;
 
 VkShaderModule loadShaderModule(VulkanFFTContext* context, const uint32_t* code, size_t codeSize);
 void createBuffer(VulkanFFTContext* context, VkBuffer* buffer, VkDeviceMemory* deviceMemory, VkBufferUsageFlags usage, VkMemoryPropertyFlags propertyFlags, VkDeviceSize size);
+void allocateVulkanFFTBuffer(VulkanFFTContext* context, VkBuffer* buffer, VkBufferUsageFlags usage, VkDeviceSize size, VkDeviceSize* scratchOffset);
+void freeVulkanFFTBuffer(VulkanFFTContext* context, VkBuffer buffer);
 VkCommandBuffer createCommandBuffer(VulkanFFTContext* context, VkCommandBufferUsageFlags usageFlags);
+void executeCommandBuffer(VulkanFFTContext* context, VkCommandBuffer commandBuffer);
 
 void bufferTransfer(VulkanFFTContext* context, VkBuffer dstBuffer, VkBuffer srcBuffer, VkDeviceSize size);
+void acquireVulkanFFTTransfer(VulkanFFTTransfer* vulkanFFTTransfer, bool download);
+void recordVulkanFFTTransfer(VulkanFFTTransfer* vulkanFFTTransfer, VkCommandBuffer commandBuffer);
+VkFence submitVulkanFFTTransfer(VulkanFFTTransfer* vulkanFFTTransfer);
+void* mapVulkanFFTTransfer(VulkanFFTTransfer* vulkanFFTTransfer);
 void* createVulkanFFTUpload(VulkanFFTTransfer* vulkanFFTTransfer);
 void* createVulkanFFTDownload(VulkanFFTTransfer* vulkanFFTTransfer);
 void freeVulkanFFTTransfer(VulkanFFTTransfer* vulkanFFTTransfer);
+// Drops the recorded copies to or from a device buffer, call it before destroying a buffer of your own which was used in a transfer
+// (freeVulkanFFTBuffer and destroyVulkanFFT do it for the buffers they free and the buffers of the user of the plan)
+void forgetVulkanFFTTransferBuffer(VulkanFFTContext* context, VkBuffer deviceBuffer);
+void destroyVulkanFFTStagingBuffer(VulkanFFTContext* context, VulkanFFTStagingBuffer* stagingBuffer);
+// Conversions between single precision and the half precision storage on the host, rounding to nearest even
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t value);
+
+typedef struct {
+    uint32_t stride[4], outputStride[4];
+    uint32_t radixStride, stageSize;
+    float directionFactor, normalizationFactor;
+    uint32_t stageCount, rowCount;
+    uint32_t stageRadix[SHARED_MEMORY_MAX_STAGES / 8];
+    uint32_t halfPrecision, columnCount;
+    uint32_t offset[2], planeOffset[2];
+} VulkanFFTPushConstants;
+
+typedef struct {
+    double time, flopCount, byteCount;
+    double gigaFlopsPerSecond, gigaBytesPerSecond;
+} VulkanFFTProfile;
+
+typedef struct {
+    uint32_t pipelineIndex, workGroupCount[3];
+    VkDescriptorSet descriptorSets[2];
+    VulkanFFTPushConstants pushConstants;
+    VulkanFFTProfile profile;
+} VulkanFFTPass;
+
+// Data in a buffer of the user: The offset is given in bytes, the strides of the x, y, z axis and between the transforms of a batch in values (all 0 for a dense layout).
+// A non zero planeOffset stores the imaginary parts that many values after the real parts, then a value is a single float instead of a complex number.
+typedef struct {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    uint32_t stride[4];
+    uint32_t planeOffset;
+} VulkanFFTBufferLayout;
 
 typedef struct {
     VulkanFFTContext* context;
-    bool inverse, resultInSwapBuffer;
+    VulkanFFTBufferLayout input, output;
+    bool inverse, realTransform, inPlace, computeTwiddleFactors, measure, profile, halfPrecision, coalesced, shareScratch, onHost, resultInSwapBuffer;
     struct VulkanFFTAxis {
         uint32_t sampleCount;
+        bool skip;
         uint32_t stageCount;
         uint32_t* stageRadix;
-        VkDeviceSize uboSize;
-        VkBuffer ubo;
-        VkDeviceMemory uboDeviceMemory;
+        bool sharedMemory;
+        uint32_t workGroupSize;
+        uint32_t bluesteinSampleCount;
+        VkBuffer bluesteinBuffer[2], bluesteinTable;
+        float* hostTable;
+        uint32_t passCount;
+        VulkanFFTPass* passes;
         VkDescriptorPool descriptorPool;
-        VkDescriptorSetLayout* descriptorSetLayouts;
-        VkDescriptorSet* descriptorSets;
-        VkPipelineLayout pipelineLayout;
+        uint32_t descriptorSetCount;
+        VkDescriptorSet descriptorSets[8];
+        uint32_t pipelineCount;
         VkPipeline* pipelines;
+        uint32_t firstQuery;
+        VulkanFFTProfile profile;
     } axes[3];
+    uint32_t batchCount;
+    // Largest power of two radix of the stages, 0 for the default of 8 (4 on the host)
+    uint32_t maxRadix;
     VkDeviceSize bufferSize;
     VkBuffer buffer[2];
-    VkDeviceMemory deviceMemory[2];
+    VkDeviceSize scratchSize;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSets[2];
+    uint32_t queryCount;
+    VkQueryPool queryPool;
 } VulkanFFTPlan;
 
-void createVulkanFFT(VulkanFFTPlan* vulkanFFTPlan);
+// Returns false without creating anything if the plan is inPlace and a row does not fit into the shared memory of a work group:
+// 8 bytes per sample, so 4096 samples with 32 KiB of shared memory, and at most SHARED_MEMORY_MAX_STAGES radix stages.
+// inPlace plans are rejected as well if an axis needs Bluestein (a prime factor above the radices), as that takes two scratch buffers of the whole volume
+bool createVulkanFFT(VulkanFFTPlan* vulkanFFTPlan);
 void recordVulkanFFT(VulkanFFTPlan* vulkanFFTPlan, VkCommandBuffer commandBuffer);
+// One submission of a pipeline of plans with their own buffers (slots): Upload uploadBuffer into the plan, download the result of the plan of the previous slot
+// into downloadBuffer and transform (without transform only the download). Uploads overlap with the transform of the previous slot on the same queue,
+// so a slot must only be submitted again after its previous submission finished, and a pipeline needs at least two slots.
+VkCommandBuffer recordVulkanFFTSlot(VulkanFFTPlan* vulkanFFTPlan, VkBuffer uploadBuffer, VulkanFFTPlan* previousPlan, VkBuffer downloadBuffer, bool transform);
+bool queryVulkanFFTProfile(VulkanFFTPlan* vulkanFFTPlan);
 void destroyVulkanFFT(VulkanFFTPlan* vulkanFFTPlan);
+// Plans with onHost are transformed by a multithreaded SIMD engine on the host, input and output have the layout of the buffers of the plan
+// preferVulkanFFTOnHost compares the cost of the plan on the host with the submit time of the (initialized) context of the plan
+bool preferVulkanFFTOnHost(VulkanFFTPlan* vulkanFFTPlan);
+void transformVulkanFFTOnHost(VulkanFFTPlan* vulkanFFTPlan, const void* input, void* output);
+
+typedef struct {
+    VkBuffer buffer;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+} VulkanFFTConvolutionKernel;
+
+typedef struct {
+    VulkanFFTPlan forward, inverse;
+    bool correlation;
+    VkPipeline pipeline;
+    VkDescriptorPool descriptorPool;
+    VulkanFFTPass pass;
+    uint32_t kernelCount;
+    VulkanFFTConvolutionKernel* kernels;
+} VulkanFFTConvolution;
+
+bool createVulkanFFTConvolution(VulkanFFTConvolution* vulkanFFTConvolution);
+uint32_t addVulkanFFTConvolutionKernel(VulkanFFTConvolution* vulkanFFTConvolution, VkCommandBuffer commandBuffer);
+void recordVulkanFFTConvolution(VulkanFFTConvolution* vulkanFFTConvolution, uint32_t kernelIndex, bool transformInput, VkCommandBuffer commandBuffer);
+void destroyVulkanFFTConvolution(VulkanFFTConvolution* vulkanFFTConvolution);
+
+// Post-processing of the result of a plan into a single channel image of width x rows: The real part, magnitude, log magnitude or phase of every value,
+// optionally centered (fftshift, except along a half spectrum), normalized to the range found by a reduction on the device and quantized to 8 or 16 bit (or 32 bit floats)
+typedef struct {
+    VulkanFFTPlan* plan;
+    uint32_t mode, bitDepth;
+    bool shift;
+    uint32_t width, height;
+    VkDeviceSize imageSize;
+    VkBuffer image, range;
+    VkPipeline pipelines[2];
+    VkDescriptorPool descriptorPool;
+    VulkanFFTPass pass;
+} VulkanFFTVisualization;
+
+void createVulkanFFTVisualization(VulkanFFTVisualization* vulkanFFTVisualization);
+void recordVulkanFFTVisualization(VulkanFFTVisualization* vulkanFFTVisualization, VkCommandBuffer commandBuffer);
+void destroyVulkanFFTVisualization(VulkanFFTVisualization* vulkanFFTVisualization);
+
+typedef struct {
+    // Chunk plan of the current step, every slot has its own device buffers
+    VulkanFFTPlan plan;
+    VkBuffer uploadBuffer, downloadBuffer;
+    VkDeviceMemory uploadDeviceMemory, downloadDeviceMemory;
+    void* uploadData;
+    void* downloadData;
+    // Upload and transform the chunk of this slot and download the result of the previous slot, or only download (after the last chunk)
+    VkCommandBuffer commandBuffer, downloadCommandBuffer;
+    VkFence fence;
+    bool pending;
+    // Chunk whose result the pending submission downloads, UINT64_MAX for none
+    uint64_t chunk;
+} VulkanFFTOutOfCoreSlot;
+
+typedef struct {
+    float* input;
+    float* output;
+    uint64_t outerCount, length, innerCount;
+    uint64_t outerChunkSize, innerChunkSize;
+    uint32_t sampleCount[3];
+    uint64_t twiddleSampleCount, transposeRowCount;
+} VulkanFFTOutOfCoreStep;
+
+typedef struct {
+    VulkanFFTPlan plan;
+    VkDeviceSize workingSetSize;
+    uint32_t slotCount;
+    VkDeviceSize chunkSize;
+    VulkanFFTOutOfCoreSlot* slots;
+} VulkanFFTOutOfCore;
+
+void createVulkanFFTOutOfCore(VulkanFFTOutOfCore* vulkanFFTOutOfCore);
+// Input and output are complex single precision values in host memory and may be the same, unless the x axis does not fit into a chunk:
+// Then it is split into columns and rows (four-step), which needs distinct buffers and overwrites the input with the intermediate result
+void transformVulkanFFTOutOfCore(VulkanFFTOutOfCore* vulkanFFTOutOfCore, void* input, void* output);
+void transformVulkanFFTMultiDevice(VulkanFFTOutOfCore* vulkanFFTOutOfCores, uint32_t deviceCount, void* input, void* output);
+void destroyVulkanFFTOutOfCore(VulkanFFTOutOfCore* vulkanFFTOutOfCore);
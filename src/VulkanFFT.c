@@ -1,6 +1,10 @@
 #include "VulkanFFT.h"
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
 #include <assert.h>
+#include <time.h>
 #define COUNT_OF(array) (sizeof(array) / sizeof(array[0]))
 
 #ifdef WIN32
@@ -9,20 +13,61 @@
 #endif
 #include <math.h>
 
+// The host engine transforms several lines at once, one complex value of each line per lane of a vector
+#if defined(__AVX__)
+#include <immintrin.h>
+#define HOST_LANE_COUNT 4
+typedef __m256 HostVector;
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HOST_LANE_COUNT 2
+typedef float32x4_t HostVector;
+#else
+#define HOST_LANE_COUNT 4
+typedef struct {
+    float values[HOST_LANE_COUNT * 2];
+} HostVector;
+#endif
+
 #include "radix2.h"
+#include "radix3.h"
 #include "radix4.h"
+#include "radix5.h"
+#include "radix7.h"
 #include "radix8.h"
+#include "sharedMemory.h"
+#include "bluestein.h"
+#include "realTransform.h"
+#include "pointwise.h"
+#include "visualize.h"
+const uint32_t supportedRadix[SUPPORTED_RADIX_COUNT] = {2, 3, 4, 5, 7, 8};
 const uint32_t* shaderModuleCode[] = {
     (uint32_t*)radix2_spv,
+    (uint32_t*)radix3_spv,
     (uint32_t*)radix4_spv,
+    (uint32_t*)radix5_spv,
+    (uint32_t*)radix7_spv,
     (uint32_t*)radix8_spv
 };
 const uint32_t shaderModuleSize[] = {
     sizeof(radix2_spv),
+    sizeof(radix3_spv),
     sizeof(radix4_spv),
+    sizeof(radix5_spv),
+    sizeof(radix7_spv),
     sizeof(radix8_spv)
 };
-const uint32_t workGroupSize = 32;
+const uint32_t defaultWorkGroupSize = 32;
+const uint32_t measureWorkGroupSizes[] = {32, 64, 128, 256};
+const uint32_t measureRepetitions = 8;
+const uint32_t sharedMemoryValuesPerInvocation = 8;
+const uint32_t sharedMemoryMaxTileWidth = 16;
+const uint32_t visualizeWorkGroupSize = 128;
+const uint32_t calibrationRepetitions = 8;
+const uint32_t calibrationExtent[3] = {64, 64, 1};
+
+void calibrateVulkanFFTHost(VulkanFFTContext* context);
+VulkanFFTStagingBuffer* addVulkanFFTStagingBuffer(VulkanFFTContext* context);
 
 void initVulkanFFTContext(VulkanFFTContext* context) {
     vkGetPhysicalDeviceProperties(context->physicalDevice, &context->physicalDeviceProperties);
@@ -31,15 +76,119 @@ void initVulkanFFTContext(VulkanFFTContext* context) {
     fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fenceCreateInfo.flags = 0;
     assert(vkCreateFence(context->device, &fenceCreateInfo, context->allocator, &context->fence) == VK_SUCCESS);
-    for(uint32_t i = 0; i < SUPPORTED_RADIX_LEVELS; ++i)
+    for(uint32_t i = 0; i < SUPPORTED_RADIX_COUNT; ++i)
         context->shaderModules[i] = loadShaderModule(context, shaderModuleCode[i], shaderModuleSize[i]);
-    context->uboAlignment = context->physicalDeviceProperties.limits.minUniformBufferOffsetAlignment;
+    context->sharedMemoryShaderModule = loadShaderModule(context, (uint32_t*)sharedMemory_spv, sizeof(sharedMemory_spv));
+    context->bluesteinShaderModule = loadShaderModule(context, (uint32_t*)bluestein_spv, sizeof(bluestein_spv));
+    context->realTransformShaderModule = loadShaderModule(context, (uint32_t*)realTransform_spv, sizeof(realTransform_spv));
+    context->pointwiseShaderModule = loadShaderModule(context, (uint32_t*)pointwise_spv, sizeof(pointwise_spv));
+    context->visualizeShaderModule = loadShaderModule(context, (uint32_t*)visualize_spv, sizeof(visualize_spv));
+    context->twiddleFactorsCount = 0;
+    // Device local memory is sub-allocated from blocks of this size
+    if(context->memoryBlockSize == 0)
+        context->memoryBlockSize = 64 << 20;
+    context->memoryBlockCount = 0;
+    context->memoryBlocks = NULL;
+    context->twiddleFactors = NULL;
+    context->wisdomCount = 0;
+    context->wisdom = NULL;
+    if(context->wisdomFileName)
+        loadVulkanFFTWisdom(context);
+
+    {
+        // An existing pipeline cache file is used as initial data, the driver ignores it if it is incompatible
+        VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {0};
+        pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        void* initialData = NULL;
+        FILE* file = (context->pipelineCacheFileName) ? fopen(context->pipelineCacheFileName, "rb") : NULL;
+        if(file) {
+            fseek(file, 0, SEEK_END);
+            pipelineCacheCreateInfo.initialDataSize = ftell(file);
+            fseek(file, 0, SEEK_SET);
+            initialData = malloc(pipelineCacheCreateInfo.initialDataSize);
+            if(fread(initialData, 1, pipelineCacheCreateInfo.initialDataSize, file) != pipelineCacheCreateInfo.initialDataSize)
+                pipelineCacheCreateInfo.initialDataSize = 0;
+            fclose(file);
+        }
+        pipelineCacheCreateInfo.pInitialData = initialData;
+        assert(vkCreatePipelineCache(context->device, &pipelineCacheCreateInfo, context->allocator, &context->pipelineCache) == VK_SUCCESS);
+        free(initialData);
+    }
+
+    {
+        // Set 0 holds the input and output buffer of a pass, set 1 the lookup table
+        for(uint32_t set = 0; set < COUNT_OF(context->descriptorSetLayouts); ++set) {
+            VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[2];
+            for(uint32_t i = 0; i < COUNT_OF(descriptorSetLayoutBindings); ++i) {
+                descriptorSetLayoutBindings[i].binding = i;
+                descriptorSetLayoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                descriptorSetLayoutBindings[i].descriptorCount = 1;
+                descriptorSetLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+                descriptorSetLayoutBindings[i].pImmutableSamplers = NULL;
+            }
+            VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {0};
+            descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            descriptorSetLayoutCreateInfo.bindingCount = COUNT_OF(descriptorSetLayoutBindings) - set;
+            descriptorSetLayoutCreateInfo.pBindings = descriptorSetLayoutBindings;
+            assert(vkCreateDescriptorSetLayout(context->device, &descriptorSetLayoutCreateInfo, context->allocator, &context->descriptorSetLayouts[set]) == VK_SUCCESS);
+        }
+        // The parameters of each pass are pushed when recording, so planning needs no uniform buffer upload
+        VkPushConstantRange pushConstantRange = {0};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(VulkanFFTPushConstants);
+        assert(pushConstantRange.size <= context->physicalDeviceProperties.limits.maxPushConstantsSize);
+        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {0};
+        pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutCreateInfo.setLayoutCount = COUNT_OF(context->descriptorSetLayouts);
+        pipelineLayoutCreateInfo.pSetLayouts = context->descriptorSetLayouts;
+        pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+        assert(vkCreatePipelineLayout(context->device, &pipelineLayoutCreateInfo, context->allocator, &context->pipelineLayout) == VK_SUCCESS);
+    }
+    context->pipelinesCount = 0;
+    context->pipelines = NULL;
+    context->nextStagingBuffer = 0;
+    context->stagingBufferCount = 0;
+    context->stagingBuffers = NULL;
+    for(uint32_t i = 0; i < VULKAN_FFT_STAGING_BUFFER_COUNT; ++i)
+        addVulkanFFTStagingBuffer(context);
+    // Calibrated by the first preferVulkanFFTOnHost only, as it takes a while
+    context->submitTime = 0.0;
+    context->hostGigaFlopsPerSecond = 0.0;
 }
 
 void freeVulkanFFTContext(VulkanFFTContext* context) {
+    for(uint32_t i = 0; i < context->stagingBufferCount; ++i) {
+        destroyVulkanFFTStagingBuffer(context, context->stagingBuffers[i]);
+        vkDestroyFence(context->device, context->stagingBuffers[i]->fence, context->allocator);
+        free(context->stagingBuffers[i]);
+    }
+    free(context->stagingBuffers);
     vkDestroyFence(context->device, context->fence, context->allocator);
-    for(uint32_t i = 0; i < SUPPORTED_RADIX_LEVELS; ++i)
+    for(uint32_t i = 0; i < SUPPORTED_RADIX_COUNT; ++i)
         vkDestroyShaderModule(context->device, context->shaderModules[i], context->allocator);
+    vkDestroyShaderModule(context->device, context->sharedMemoryShaderModule, context->allocator);
+    vkDestroyShaderModule(context->device, context->bluesteinShaderModule, context->allocator);
+    vkDestroyShaderModule(context->device, context->realTransformShaderModule, context->allocator);
+    vkDestroyShaderModule(context->device, context->pointwiseShaderModule, context->allocator);
+    vkDestroyShaderModule(context->device, context->visualizeShaderModule, context->allocator);
+    for(uint32_t i = 0; i < context->twiddleFactorsCount; ++i)
+        freeVulkanFFTBuffer(context, context->twiddleFactors[i].buffer);
+    free(context->twiddleFactors);
+    for(uint32_t i = 0; i < context->memoryBlockCount; ++i) {
+        vkFreeMemory(context->device, context->memoryBlocks[i].deviceMemory, context->allocator);
+        free(context->memoryBlocks[i].ranges);
+    }
+    free(context->memoryBlocks);
+    free(context->wisdom);
+    for(uint32_t i = 0; i < context->pipelinesCount; ++i)
+        vkDestroyPipeline(context->device, context->pipelines[i].pipeline, context->allocator);
+    free(context->pipelines);
+    vkDestroyPipelineLayout(context->device, context->pipelineLayout, context->allocator);
+    for(uint32_t i = 0; i < COUNT_OF(context->descriptorSetLayouts); ++i)
+        vkDestroyDescriptorSetLayout(context->device, context->descriptorSetLayouts[i], context->allocator);
+    vkDestroyPipelineCache(context->device, context->pipelineCache, context->allocator);
 }
 
 
@@ -58,10 +207,12 @@ uint32_t findMemoryType(VulkanFFTContext* context, uint32_t typeFilter, VkMemory
     for(uint32_t i = 0; i < context->physicalDeviceMemoryProperties.memoryTypeCount; ++i)
         if((typeFilter & (1 << i)) && (context->physicalDeviceMemoryProperties.memoryTypes[i].propertyFlags & propertyFlags) == propertyFlags)
             return i;
+    // No memory type has all requested properties
+    assert(false);
     return 0;
 }
 
-void createBuffer(VulkanFFTContext* context, VkBuffer* buffer, VkDeviceMemory* deviceMemory, VkBufferUsageFlags usage, VkMemoryPropertyFlags propertyFlags, VkDeviceSize size) {
+VkMemoryRequirements createUnboundBuffer(VulkanFFTContext* context, VkBuffer* buffer, VkBufferUsageFlags usage, VkDeviceSize size) {
     uint32_t queueFamilyIndices[1] = {0};
     VkBufferCreateInfo bufferCreateInfo = {0};
     bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -73,6 +224,11 @@ void createBuffer(VulkanFFTContext* context, VkBuffer* buffer, VkDeviceMemory* d
     assert(vkCreateBuffer(context->device, &bufferCreateInfo, context->allocator, buffer) == VK_SUCCESS);
     VkMemoryRequirements memoryRequirements;
     vkGetBufferMemoryRequirements(context->device, *buffer, &memoryRequirements);
+    return memoryRequirements;
+}
+
+void createBuffer(VulkanFFTContext* context, VkBuffer* buffer, VkDeviceMemory* deviceMemory, VkBufferUsageFlags usage, VkMemoryPropertyFlags propertyFlags, VkDeviceSize size) {
+    VkMemoryRequirements memoryRequirements = createUnboundBuffer(context, buffer, usage, size);
     VkMemoryAllocateInfo memoryAllocateInfo = {0};
     memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     memoryAllocateInfo.allocationSize = memoryRequirements.size;
@@ -81,6 +237,88 @@ void createBuffer(VulkanFFTContext* context, VkBuffer* buffer, VkDeviceMemory* d
     vkBindBufferMemory(context->device, *buffer, *deviceMemory, 0);
 }
 
+void allocateVulkanFFTBuffer(VulkanFFTContext* context, VkBuffer* buffer, VkBufferUsageFlags usage, VkDeviceSize size, VkDeviceSize* scratchOffset) {
+    // Device local buffers are sub-allocated from shared memory blocks of the context.
+    // Scratch buffers are placed at increasing offsets per plan (scratchOffset), plans which never run concurrently alias the same scratch block.
+    VkMemoryRequirements memoryRequirements = createUnboundBuffer(context, buffer, usage, size);
+    uint32_t memoryTypeIndex = findMemoryType(context, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VulkanFFTMemoryBlock* block = NULL;
+    VkDeviceSize offset = 0;
+    if(scratchOffset) {
+        offset = (*scratchOffset + memoryRequirements.alignment - 1) / memoryRequirements.alignment * memoryRequirements.alignment;
+        *scratchOffset = offset + memoryRequirements.size;
+        // Only the latest scratch block is reused, a larger one replaces it for all plans created afterwards
+        for(uint32_t i = context->memoryBlockCount; i > 0 && !block; --i)
+            if(context->memoryBlocks[i - 1].scratch && context->memoryBlocks[i - 1].memoryTypeIndex == memoryTypeIndex)
+                block = &context->memoryBlocks[i - 1];
+        if(block && block->size < *scratchOffset)
+            block = NULL;
+    } else
+        for(uint32_t i = 0; i < context->memoryBlockCount && !block; ++i) {
+            VulkanFFTMemoryBlock* candidate = &context->memoryBlocks[i];
+            if(candidate->scratch || candidate->memoryTypeIndex != memoryTypeIndex)
+                continue;
+            // First fit in the gaps between the ranges, which are sorted by offset
+            offset = 0;
+            for(uint32_t j = 0; j <= candidate->rangeCount; ++j) {
+                offset = (offset + memoryRequirements.alignment - 1) / memoryRequirements.alignment * memoryRequirements.alignment;
+                if(offset + memoryRequirements.size <= ((j < candidate->rangeCount) ? candidate->ranges[j].offset : candidate->size)) {
+                    block = candidate;
+                    break;
+                }
+                if(j < candidate->rangeCount)
+                    offset = candidate->ranges[j].offset + candidate->ranges[j].size;
+            }
+        }
+    if(!block) {
+        context->memoryBlocks = (VulkanFFTMemoryBlock*)realloc(context->memoryBlocks, sizeof(VulkanFFTMemoryBlock) * (context->memoryBlockCount + 1));
+        block = &context->memoryBlocks[context->memoryBlockCount++];
+        block->memoryTypeIndex = memoryTypeIndex;
+        block->scratch = scratchOffset != NULL;
+        block->size = (scratchOffset) ? *scratchOffset : (memoryRequirements.size > context->memoryBlockSize) ? memoryRequirements.size : context->memoryBlockSize;
+        block->rangeCount = 0;
+        block->ranges = NULL;
+        if(!scratchOffset)
+            offset = 0;
+        VkMemoryAllocateInfo memoryAllocateInfo = {0};
+        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memoryAllocateInfo.allocationSize = block->size;
+        memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
+        assert(vkAllocateMemory(context->device, &memoryAllocateInfo, context->allocator, &block->deviceMemory) == VK_SUCCESS);
+    }
+    uint32_t j = 0;
+    while(j < block->rangeCount && block->ranges[j].offset < offset)
+        ++j;
+    block->ranges = (VulkanFFTMemoryRange*)realloc(block->ranges, sizeof(VulkanFFTMemoryRange) * (block->rangeCount + 1));
+    memmove(&block->ranges[j + 1], &block->ranges[j], sizeof(VulkanFFTMemoryRange) * (block->rangeCount - j));
+    block->ranges[j].buffer = *buffer;
+    block->ranges[j].offset = offset;
+    block->ranges[j].size = memoryRequirements.size;
+    ++block->rangeCount;
+    vkBindBufferMemory(context->device, *buffer, block->deviceMemory, offset);
+}
+
+void freeVulkanFFTBuffer(VulkanFFTContext* context, VkBuffer buffer) {
+    forgetVulkanFFTTransferBuffer(context, buffer);
+    vkDestroyBuffer(context->device, buffer, context->allocator);
+    for(uint32_t i = 0; i < context->memoryBlockCount; ++i) {
+        VulkanFFTMemoryBlock* block = &context->memoryBlocks[i];
+        for(uint32_t j = 0; j < block->rangeCount; ++j) {
+            if(block->ranges[j].buffer != buffer)
+                continue;
+            memmove(&block->ranges[j], &block->ranges[j + 1], sizeof(VulkanFFTMemoryRange) * (block->rangeCount - j - 1));
+            // Empty blocks are freed, the order of the remaining ones is kept
+            if(--block->rangeCount == 0) {
+                vkFreeMemory(context->device, block->deviceMemory, context->allocator);
+                free(block->ranges);
+                memmove(block, block + 1, sizeof(VulkanFFTMemoryBlock) * (context->memoryBlockCount - i - 1));
+                --context->memoryBlockCount;
+            }
+            return;
+        }
+    }
+}
+
 VkCommandBuffer createCommandBuffer(VulkanFFTContext* context, VkCommandBufferUsageFlags usageFlags) {
     VkCommandBufferAllocateInfo commandBufferAllocateInfo = {0};
     commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -96,8 +334,46 @@ VkCommandBuffer createCommandBuffer(VulkanFFTContext* context, VkCommandBufferUs
     return commandBuffer;
 }
 
+VkDescriptorSet createVulkanFFTDescriptorSet(VulkanFFTContext* context, VkDescriptorPool descriptorPool, uint32_t set, const VkBuffer* buffers) {
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {0};
+    descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.descriptorPool = descriptorPool;
+    descriptorSetAllocateInfo.descriptorSetCount = 1;
+    descriptorSetAllocateInfo.pSetLayouts = &context->descriptorSetLayouts[set];
+    VkDescriptorSet descriptorSet;
+    assert(vkAllocateDescriptorSets(context->device, &descriptorSetAllocateInfo, &descriptorSet) == VK_SUCCESS);
+    VkDescriptorBufferInfo descriptorBufferInfos[2];
+    uint32_t bindingCount = 2 - set;
+    for(uint32_t i = 0; i < bindingCount; ++i) {
+        descriptorBufferInfos[i].buffer = buffers[i];
+        descriptorBufferInfos[i].offset = 0;
+        descriptorBufferInfos[i].range = VK_WHOLE_SIZE;
+    }
+    VkWriteDescriptorSet writeDescriptorSet = {0};
+    writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeDescriptorSet.dstSet = descriptorSet;
+    writeDescriptorSet.dstBinding = 0;
+    writeDescriptorSet.dstArrayElement = 0;
+    writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writeDescriptorSet.descriptorCount = bindingCount;
+    writeDescriptorSet.pBufferInfo = descriptorBufferInfos;
+    vkUpdateDescriptorSets(context->device, 1, &writeDescriptorSet, 0, NULL);
+    return descriptorSet;
+}
+
 
 
+void executeCommandBuffer(VulkanFFTContext* context, VkCommandBuffer commandBuffer) {
+    VkSubmitInfo submitInfo = {0};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    assert(vkQueueSubmit(context->queue, 1, &submitInfo, context->fence) == VK_SUCCESS);
+    assert(vkWaitForFences(context->device, 1, &context->fence, VK_TRUE, 100000000000) == VK_SUCCESS);
+    assert(vkResetFences(context->device, 1, &context->fence) == VK_SUCCESS);
+    vkFreeCommandBuffers(context->device, context->commandPool, 1, &commandBuffer);
+}
+
 void bufferTransfer(VulkanFFTContext* context, VkBuffer dstBuffer, VkBuffer srcBuffer, VkDeviceSize size) {
     VkCommandBuffer commandBuffer = createCommandBuffer(context, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
     VkBufferCopy copyRegion = {0};
@@ -106,243 +382,1961 @@ void bufferTransfer(VulkanFFTContext* context, VkBuffer dstBuffer, VkBuffer srcB
     copyRegion.size = size;
     vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
     vkEndCommandBuffer(commandBuffer);
+    executeCommandBuffer(context, commandBuffer);
+}
+
+void waitVulkanFFTStagingBuffer(VulkanFFTContext* context, VulkanFFTStagingBuffer* stagingBuffer) {
+    if(!stagingBuffer->pending)
+        return;
+    assert(vkWaitForFences(context->device, 1, &stagingBuffer->fence, VK_TRUE, 100000000000) == VK_SUCCESS);
+    assert(vkResetFences(context->device, 1, &stagingBuffer->fence) == VK_SUCCESS);
+    stagingBuffer->pending = false;
+}
+
+void destroyVulkanFFTStagingBuffer(VulkanFFTContext* context, VulkanFFTStagingBuffer* stagingBuffer) {
+    waitVulkanFFTStagingBuffer(context, stagingBuffer);
+    if(stagingBuffer->commandBuffer)
+        vkFreeCommandBuffers(context->device, context->commandPool, 1, &stagingBuffer->commandBuffer);
+    stagingBuffer->commandBuffer = VK_NULL_HANDLE;
+    stagingBuffer->recordedDeviceBuffer = VK_NULL_HANDLE;
+    if(stagingBuffer->size == 0)
+        return;
+    vkUnmapMemory(context->device, stagingBuffer->deviceMemory);
+    vkDestroyBuffer(context->device, stagingBuffer->buffer, context->allocator);
+    vkFreeMemory(context->device, stagingBuffer->deviceMemory, context->allocator);
+    stagingBuffer->size = 0;
+}
+
+VulkanFFTStagingBuffer* addVulkanFFTStagingBuffer(VulkanFFTContext* context) {
+    VulkanFFTStagingBuffer* stagingBuffer = (VulkanFFTStagingBuffer*)calloc(1, sizeof(VulkanFFTStagingBuffer));
+    VkFenceCreateInfo fenceCreateInfo = {0};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    assert(vkCreateFence(context->device, &fenceCreateInfo, context->allocator, &stagingBuffer->fence) == VK_SUCCESS);
+    context->stagingBuffers = (VulkanFFTStagingBuffer**)realloc(context->stagingBuffers, sizeof(VulkanFFTStagingBuffer*) * (context->stagingBufferCount + 1));
+    context->stagingBuffers[context->stagingBufferCount++] = stagingBuffer;
+    return stagingBuffer;
+}
+
+void forgetVulkanFFTTransferBuffer(VulkanFFTContext* context, VkBuffer deviceBuffer) {
+    // A later buffer can get the same handle, so the recorded copies must not outlive the buffer
+    for(uint32_t i = 0; i < context->stagingBufferCount; ++i) {
+        VulkanFFTStagingBuffer* stagingBuffer = context->stagingBuffers[i];
+        if(stagingBuffer->recordedDeviceBuffer != deviceBuffer || !deviceBuffer)
+            continue;
+        waitVulkanFFTStagingBuffer(context, stagingBuffer);
+        vkFreeCommandBuffers(context->device, context->commandPool, 1, &stagingBuffer->commandBuffer);
+        stagingBuffer->commandBuffer = VK_NULL_HANDLE;
+        stagingBuffer->recordedDeviceBuffer = VK_NULL_HANDLE;
+    }
+}
+
+void acquireVulkanFFTTransfer(VulkanFFTTransfer* vulkanFFTTransfer, bool download) {
+    // Staging buffers are taken from a ring in the context, stay mapped and only grow
+    VulkanFFTContext* context = vulkanFFTTransfer->context;
+    VulkanFFTStagingBuffer* stagingBuffer = NULL;
+    for(uint32_t i = 0; i < context->stagingBufferCount && !stagingBuffer; ++i) {
+        if(!context->stagingBuffers[context->nextStagingBuffer]->inUse)
+            stagingBuffer = context->stagingBuffers[context->nextStagingBuffer];
+        context->nextStagingBuffer = (context->nextStagingBuffer + 1) % context->stagingBufferCount;
+    }
+    // All staging buffers are held by transfers which were not freed yet, waiting would not release any of them
+    if(!stagingBuffer)
+        stagingBuffer = addVulkanFFTStagingBuffer(context);
+    waitVulkanFFTStagingBuffer(context, stagingBuffer);
+    if(stagingBuffer->size < vulkanFFTTransfer->size) {
+        destroyVulkanFFTStagingBuffer(context, stagingBuffer);
+        stagingBuffer->size = vulkanFFTTransfer->size;
+        createBuffer(context, &stagingBuffer->buffer, &stagingBuffer->deviceMemory, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer->size);
+        vkMapMemory(context->device, stagingBuffer->deviceMemory, 0, stagingBuffer->size, 0, &stagingBuffer->map);
+    }
+    stagingBuffer->inUse = true;
+    vulkanFFTTransfer->stagingBuffer = stagingBuffer;
+    vulkanFFTTransfer->download = download;
+    vulkanFFTTransfer->submitted = false;
+}
+
+void recordVulkanFFTTransfer(VulkanFFTTransfer* vulkanFFTTransfer, VkCommandBuffer commandBuffer) {
+    VkMemoryBarrier memoryBarrier = {0};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+    VkBufferCopy copyRegion = {0};
+    copyRegion.srcOffset = 0;
+    copyRegion.dstOffset = 0;
+    copyRegion.size = vulkanFFTTransfer->size;
+    if(vulkanFFTTransfer->download)
+        vkCmdCopyBuffer(commandBuffer, vulkanFFTTransfer->deviceBuffer, vulkanFFTTransfer->stagingBuffer->buffer, 1, &copyRegion);
+    else
+        vkCmdCopyBuffer(commandBuffer, vulkanFFTTransfer->stagingBuffer->buffer, vulkanFFTTransfer->deviceBuffer, 1, &copyRegion);
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+    vulkanFFTTransfer->submitted = true;
+}
+
+VkFence submitVulkanFFTTransfer(VulkanFFTTransfer* vulkanFFTTransfer) {
+    VulkanFFTContext* context = vulkanFFTTransfer->context;
+    VulkanFFTStagingBuffer* stagingBuffer = vulkanFFTTransfer->stagingBuffer;
+    // The copy command buffer is only recorded again if the transfer differs from the previous one of this staging buffer
+    if(stagingBuffer->recordedDeviceBuffer != vulkanFFTTransfer->deviceBuffer || stagingBuffer->recordedSize != vulkanFFTTransfer->size || stagingBuffer->recordedDownload != vulkanFFTTransfer->download) {
+        if(stagingBuffer->commandBuffer)
+            vkFreeCommandBuffers(context->device, context->commandPool, 1, &stagingBuffer->commandBuffer);
+        stagingBuffer->commandBuffer = createCommandBuffer(context, 0);
+        recordVulkanFFTTransfer(vulkanFFTTransfer, stagingBuffer->commandBuffer);
+        vkEndCommandBuffer(stagingBuffer->commandBuffer);
+        stagingBuffer->recordedDeviceBuffer = vulkanFFTTransfer->deviceBuffer;
+        stagingBuffer->recordedSize = vulkanFFTTransfer->size;
+        stagingBuffer->recordedDownload = vulkanFFTTransfer->download;
+    }
     VkSubmitInfo submitInfo = {0};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-    assert(vkQueueSubmit(context->queue, 1, &submitInfo, context->fence) == VK_SUCCESS);
-    assert(vkWaitForFences(context->device, 1, &context->fence, VK_TRUE, 100000000000) == VK_SUCCESS);
-    assert(vkResetFences(context->device, 1, &context->fence) == VK_SUCCESS);
-    vkFreeCommandBuffers(context->device, context->commandPool, 1, &commandBuffer);
+    submitInfo.pCommandBuffers = &stagingBuffer->commandBuffer;
+    assert(vkQueueSubmit(context->queue, 1, &submitInfo, stagingBuffer->fence) == VK_SUCCESS);
+    stagingBuffer->pending = true;
+    vulkanFFTTransfer->submitted = true;
+    return stagingBuffer->fence;
+}
+
+void* mapVulkanFFTTransfer(VulkanFFTTransfer* vulkanFFTTransfer) {
+    waitVulkanFFTStagingBuffer(vulkanFFTTransfer->context, vulkanFFTTransfer->stagingBuffer);
+    return vulkanFFTTransfer->stagingBuffer->map;
 }
 
 void* createVulkanFFTUpload(VulkanFFTTransfer* vulkanFFTTransfer) {
-    createBuffer(vulkanFFTTransfer->context, &vulkanFFTTransfer->hostBuffer, &vulkanFFTTransfer->deviceMemory, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vulkanFFTTransfer->size);
-    void* map;
-    vkMapMemory(vulkanFFTTransfer->context->device, vulkanFFTTransfer->deviceMemory, 0, vulkanFFTTransfer->size, 0, &map);
-    return map;
+    acquireVulkanFFTTransfer(vulkanFFTTransfer, false);
+    return vulkanFFTTransfer->stagingBuffer->map;
 }
 
 void* createVulkanFFTDownload(VulkanFFTTransfer* vulkanFFTTransfer) {
-    createBuffer(vulkanFFTTransfer->context, &vulkanFFTTransfer->hostBuffer, &vulkanFFTTransfer->deviceMemory, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vulkanFFTTransfer->size);
-    bufferTransfer(vulkanFFTTransfer->context, vulkanFFTTransfer->hostBuffer, vulkanFFTTransfer->deviceBuffer, vulkanFFTTransfer->size);
-    vulkanFFTTransfer->deviceBuffer = VK_NULL_HANDLE;
-    void* map;
-    vkMapMemory(vulkanFFTTransfer->context->device, vulkanFFTTransfer->deviceMemory, 0, vulkanFFTTransfer->size, 0, &map);
-    return map;
+    acquireVulkanFFTTransfer(vulkanFFTTransfer, true);
+    submitVulkanFFTTransfer(vulkanFFTTransfer);
+    return mapVulkanFFTTransfer(vulkanFFTTransfer);
 }
 
 void freeVulkanFFTTransfer(VulkanFFTTransfer* vulkanFFTTransfer) {
-    if(vulkanFFTTransfer->deviceBuffer)
-        bufferTransfer(vulkanFFTTransfer->context, vulkanFFTTransfer->deviceBuffer, vulkanFFTTransfer->hostBuffer, vulkanFFTTransfer->size);
-    vkUnmapMemory(vulkanFFTTransfer->context->device, vulkanFFTTransfer->deviceMemory);
-    vkDestroyBuffer(vulkanFFTTransfer->context->device, vulkanFFTTransfer->hostBuffer, vulkanFFTTransfer->context->allocator);
-    vkFreeMemory(vulkanFFTTransfer->context->device, vulkanFFTTransfer->deviceMemory, vulkanFFTTransfer->context->allocator);
+    // Uploads which were not submitted yet are submitted now, but not waited for
+    if(!vulkanFFTTransfer->download && !vulkanFFTTransfer->submitted)
+        submitVulkanFFTTransfer(vulkanFFTTransfer);
+    vulkanFFTTransfer->stagingBuffer->inUse = false;
+    vulkanFFTTransfer->stagingBuffer = NULL;
+}
+
+uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000, mantissa = bits & 0x7FFFFF;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+    if(exponent >= 31)
+        return sign | ((((bits >> 23) & 0xFF) == 0xFF && mantissa) ? 0x7E00 : 0x7C00);
+    if(exponent <= 0) {
+        if(exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift, remainder = mantissa & ((1 << shift) - 1), midpoint = 1 << (shift - 1);
+        return sign | (half + (remainder > midpoint || (remainder == midpoint && (half & 1))));
+    }
+    // Round to nearest even, a carry into the exponent is intended
+    uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13), remainder = mantissa & 0x1FFF;
+    return sign | (half + (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))));
 }
 
+float halfToFloat(uint16_t value) {
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16, exponent = (value >> 10) & 0x1F, mantissa = value & 0x3FF, bits;
+    if(exponent == 0x1F)
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    else if(exponent != 0)
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    else if(mantissa == 0)
+        bits = sign;
+    else {
+        exponent = 127 - 15 + 1;
+        while(!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+    }
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
 
 
-typedef struct {
-    uint32_t stride[3];
-    uint32_t radixStride, stageSize;
-    float directionFactor;
-    float angleFactor;
-    float normalizationFactor;
-} VulkanFFTUBO;
+
+VkBuffer acquireVulkanFFTTwiddleFactors(VulkanFFTContext* context, uint32_t sampleCount) {
+    for(uint32_t i = 0; i < context->twiddleFactorsCount; ++i)
+        if(context->twiddleFactors[i].sampleCount == sampleCount) {
+            ++context->twiddleFactors[i].referenceCount;
+            return context->twiddleFactors[i].buffer;
+        }
+    context->twiddleFactors = (VulkanFFTTwiddleFactors*)realloc(context->twiddleFactors, sizeof(VulkanFFTTwiddleFactors) * (context->twiddleFactorsCount + 1));
+    VulkanFFTTwiddleFactors* twiddleFactors = &context->twiddleFactors[context->twiddleFactorsCount++];
+    twiddleFactors->sampleCount = sampleCount;
+    twiddleFactors->referenceCount = 1;
+    VulkanFFTTransfer vulkanFFTTransfer;
+    vulkanFFTTransfer.context = context;
+    vulkanFFTTransfer.size = sizeof(float) * 2 * sampleCount;
+    allocateVulkanFFTBuffer(context, &twiddleFactors->buffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, vulkanFFTTransfer.size, NULL);
+    vulkanFFTTransfer.deviceBuffer = twiddleFactors->buffer;
+    float* values = (float*)createVulkanFFTUpload(&vulkanFFTTransfer);
+    for(uint32_t i = 0; i < sampleCount; ++i) {
+        double angle = 2.0 * M_PI * i / sampleCount;
+        values[i * 2] = (float)cos(angle);
+        values[i * 2 + 1] = (float)sin(angle);
+    }
+    freeVulkanFFTTransfer(&vulkanFFTTransfer);
+    return twiddleFactors->buffer;
+}
+
+void releaseVulkanFFTTwiddleFactors(VulkanFFTContext* context, uint32_t sampleCount) {
+    for(uint32_t i = 0; i < context->twiddleFactorsCount; ++i)
+        if(context->twiddleFactors[i].sampleCount == sampleCount) {
+            if(--context->twiddleFactors[i].referenceCount > 0)
+                return;
+            freeVulkanFFTBuffer(context, context->twiddleFactors[i].buffer);
+            context->twiddleFactors[i] = context->twiddleFactors[--context->twiddleFactorsCount];
+            return;
+        }
+}
+
+VkPipeline acquireVulkanFFTPipeline(VulkanFFTContext* context, VkShaderModule shaderModule, const uint32_t* specializationData) {
+    for(uint32_t i = 0; i < context->pipelinesCount; ++i)
+        if(context->pipelines[i].shaderModule == shaderModule && memcmp(context->pipelines[i].specializationData, specializationData, sizeof(context->pipelines[i].specializationData)) == 0) {
+            ++context->pipelines[i].referenceCount;
+            return context->pipelines[i].pipeline;
+        }
+    context->pipelines = (VulkanFFTPipeline*)realloc(context->pipelines, sizeof(VulkanFFTPipeline) * (context->pipelinesCount + 1));
+    VulkanFFTPipeline* pipeline = &context->pipelines[context->pipelinesCount++];
+    pipeline->shaderModule = shaderModule;
+    memcpy(pipeline->specializationData, specializationData, sizeof(pipeline->specializationData));
+    pipeline->referenceCount = 1;
+    VkSpecializationMapEntry specializationMapEntries[VULKAN_FFT_SPECIALIZATION_CONSTANT_COUNT];
+    for(uint32_t i = 0; i < COUNT_OF(specializationMapEntries); ++i) {
+        specializationMapEntries[i].constantID = i;
+        specializationMapEntries[i].offset = sizeof(uint32_t) * i;
+        specializationMapEntries[i].size = sizeof(uint32_t);
+    }
+    VkSpecializationInfo specializationInfo = {0};
+    specializationInfo.mapEntryCount = COUNT_OF(specializationMapEntries);
+    specializationInfo.pMapEntries = specializationMapEntries;
+    specializationInfo.dataSize = sizeof(pipeline->specializationData);
+    specializationInfo.pData = pipeline->specializationData;
+    VkComputePipelineCreateInfo computePipelineCreateInfo = {0};
+    computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    computePipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    computePipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    computePipelineCreateInfo.stage.module = shaderModule;
+    computePipelineCreateInfo.stage.pName = "main";
+    computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+    computePipelineCreateInfo.layout = context->pipelineLayout;
+    assert(vkCreateComputePipelines(context->device, context->pipelineCache, 1, &computePipelineCreateInfo, context->allocator, &pipeline->pipeline) == VK_SUCCESS);
+    return pipeline->pipeline;
+}
+
+void releaseVulkanFFTPipeline(VulkanFFTContext* context, VkPipeline pipeline) {
+    for(uint32_t i = 0; i < context->pipelinesCount; ++i)
+        if(context->pipelines[i].pipeline == pipeline) {
+            if(--context->pipelines[i].referenceCount > 0)
+                return;
+            vkDestroyPipeline(context->device, context->pipelines[i].pipeline, context->allocator);
+            context->pipelines[i] = context->pipelines[--context->pipelinesCount];
+            return;
+        }
+}
+
+void saveVulkanFFTPipelineCache(VulkanFFTContext* context) {
+    size_t size;
+    assert(vkGetPipelineCacheData(context->device, context->pipelineCache, &size, NULL) == VK_SUCCESS);
+    void* data = malloc(size);
+    assert(vkGetPipelineCacheData(context->device, context->pipelineCache, &size, data) == VK_SUCCESS);
+    FILE* file = fopen(context->pipelineCacheFileName, "wb");
+    assert(file);
+    assert(fwrite(data, 1, size, file) == size);
+    fclose(file);
+    free(data);
+}
+
+// Wisdom is only valid for the device and driver it was measured with, the leading version rejects files of an older format
+void getVulkanFFTWisdomDeviceKey(VulkanFFTContext* context, char* deviceKey) {
+    deviceKey += sprintf(deviceKey, "2 %08x %08x %08x ", context->physicalDeviceProperties.vendorID, context->physicalDeviceProperties.deviceID, context->physicalDeviceProperties.driverVersion);
+    for(uint32_t i = 0; i < VK_UUID_SIZE; ++i)
+        deviceKey += sprintf(deviceKey, "%02x", context->physicalDeviceProperties.pipelineCacheUUID[i]);
+}
+
+bool isVulkanFFTWisdomValid(const VulkanFFTWisdom* wisdom) {
+    // Entries of a damaged or edited file must still describe a plan which transforms correctly
+    if(wisdom->stageCount == 0 || wisdom->stageCount > MAX_STAGE_COUNT || (wisdom->sharedMemory && wisdom->stageCount > SHARED_MEMORY_MAX_STAGES) || (wisdom->inPlace && !wisdom->sharedMemory) || wisdom->workGroupSize == 0)
+        return false;
+    uint64_t sampleCount = 1;
+    for(uint32_t i = 0; i < wisdom->stageCount; ++i) {
+        uint32_t radixIndex = 0;
+        while(radixIndex < SUPPORTED_RADIX_COUNT && supportedRadix[radixIndex] != wisdom->stageRadix[i])
+            ++radixIndex;
+        if(radixIndex == SUPPORTED_RADIX_COUNT || (wisdom->stageRadix[i] > wisdom->maxRadix && (wisdom->stageRadix[i] & (wisdom->stageRadix[i] - 1)) == 0))
+            return false;
+        sampleCount *= wisdom->stageRadix[i];
+    }
+    return sampleCount == wisdom->sampleCount;
+}
+
+void loadVulkanFFTWisdom(VulkanFFTContext* context) {
+    FILE* file = fopen(context->wisdomFileName, "r");
+    if(!file)
+        return;
+    char deviceKey[64], fileDeviceKey[64];
+    getVulkanFFTWisdomDeviceKey(context, deviceKey);
+    if(!fgets(fileDeviceKey, sizeof(fileDeviceKey), file) || strncmp(deviceKey, fileDeviceKey, strlen(deviceKey)) != 0) {
+        fclose(file);
+        return;
+    }
+    VulkanFFTWisdom wisdom = {0};
+    uint32_t inPlace, sharedMemory;
+    while(fscanf(file, "%u %u %u %u %u %u %u %u %u", &wisdom.axis, &wisdom.sampleCount, &wisdom.rowCount[0], &wisdom.rowCount[1], &wisdom.maxRadix, &inPlace, &sharedMemory, &wisdom.workGroupSize, &wisdom.stageCount) == 9) {
+        // The radices of an entry with too many stages can not be skipped reliably, so the rest of the file is ignored
+        if(wisdom.stageCount > MAX_STAGE_COUNT)
+            break;
+        uint32_t i = 0;
+        while(i < wisdom.stageCount && fscanf(file, "%u", &wisdom.stageRadix[i]) == 1)
+            ++i;
+        if(i < wisdom.stageCount)
+            break;
+        wisdom.inPlace = inPlace;
+        wisdom.sharedMemory = sharedMemory;
+        if(!isVulkanFFTWisdomValid(&wisdom))
+            continue;
+        context->wisdom = (VulkanFFTWisdom*)realloc(context->wisdom, sizeof(VulkanFFTWisdom) * (context->wisdomCount + 1));
+        context->wisdom[context->wisdomCount++] = wisdom;
+    }
+    fclose(file);
+}
+
+void saveVulkanFFTWisdom(VulkanFFTContext* context) {
+    FILE* file = fopen(context->wisdomFileName, "w");
+    assert(file);
+    char deviceKey[64];
+    getVulkanFFTWisdomDeviceKey(context, deviceKey);
+    fprintf(file, "%s\n", deviceKey);
+    for(uint32_t i = 0; i < context->wisdomCount; ++i) {
+        VulkanFFTWisdom* wisdom = &context->wisdom[i];
+        fprintf(file, "%u %u %u %u %u %u %u %u %u", wisdom->axis, wisdom->sampleCount, wisdom->rowCount[0], wisdom->rowCount[1], wisdom->maxRadix, wisdom->inPlace, wisdom->sharedMemory, wisdom->workGroupSize, wisdom->stageCount);
+        for(uint32_t j = 0; j < wisdom->stageCount; ++j)
+            fprintf(file, " %u", wisdom->stageRadix[j]);
+        fprintf(file, "\n");
+    }
+    fclose(file);
+}
+
+// Greedily picks the largest radix first, power of two radices are limited to maxRadix
+uint32_t factorizeSampleCount(uint32_t sampleCount, uint32_t maxRadix, uint32_t* stageRadix) {
+    uint32_t stageCount = 0;
+    while(sampleCount > 1) {
+        uint32_t radixIndex = SUPPORTED_RADIX_COUNT;
+        do {
+            if(radixIndex == 0)
+                return 0;
+            --radixIndex;
+        } while(sampleCount % supportedRadix[radixIndex] > 0 || (supportedRadix[radixIndex] > maxRadix && (supportedRadix[radixIndex] & (supportedRadix[radixIndex] - 1)) == 0));
+        assert(stageCount < MAX_STAGE_COUNT);
+        stageRadix[stageCount++] = supportedRadix[radixIndex];
+        sampleCount /= supportedRadix[radixIndex];
+    }
+    return stageCount;
+}
+
+void transformOnHost(double* values, uint32_t sampleCount, double directionFactor) {
+    for(uint32_t i = 1, j = 0; i < sampleCount; ++i) {
+        uint32_t bit = sampleCount >> 1;
+        for(; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if(i < j)
+            for(uint32_t k = 0; k < 2; ++k) {
+                double aux = values[i * 2 + k];
+                values[i * 2 + k] = values[j * 2 + k];
+                values[j * 2 + k] = aux;
+            }
+    }
+    for(uint32_t stageSize = 1; stageSize < sampleCount; stageSize <<= 1)
+        for(uint32_t i = 0; i < sampleCount; i += stageSize * 2)
+            for(uint32_t k = 0; k < stageSize; ++k) {
+                double angle = directionFactor * M_PI * k / stageSize;
+                double* a = &values[(i + k) * 2];
+                double* b = &values[(i + k + stageSize) * 2];
+                double t[2] = {b[0] * cos(angle) - b[1] * sin(angle), b[0] * sin(angle) + b[1] * cos(angle)};
+                b[0] = a[0] - t[0];
+                b[1] = a[1] - t[1];
+                a[0] += t[0];
+                a[1] += t[1];
+            }
+}
+
+void fillVulkanFFTBluesteinTable(float* table, uint32_t sampleCount, uint32_t bluesteinSampleCount, double directionFactor, double kernelFactor) {
+    // The table holds the chirp followed by the spectrum of its conjugate (the convolution kernel)
+    double* kernel = (double*)calloc(bluesteinSampleCount * 2, sizeof(double));
+    for(uint32_t i = 0; i < sampleCount; ++i) {
+        double angle = directionFactor * M_PI * ((uint64_t)i * i % (sampleCount * 2)) / sampleCount;
+        table[i * 2] = (float)cos(angle);
+        table[i * 2 + 1] = (float)sin(angle);
+        kernel[i * 2] = cos(angle);
+        kernel[i * 2 + 1] = -sin(angle);
+        if(i == 0)
+            continue;
+        kernel[(bluesteinSampleCount - i) * 2] = kernel[i * 2];
+        kernel[(bluesteinSampleCount - i) * 2 + 1] = kernel[i * 2 + 1];
+    }
+    transformOnHost(kernel, bluesteinSampleCount, 1.0);
+    for(uint32_t i = 0; i < bluesteinSampleCount * 2; ++i)
+        table[sampleCount * 2 + i] = (float)(kernel[i] * kernelFactor);
+    free(kernel);
+}
 
 typedef struct VulkanFFTAxis VulkanFFTAxis;
 
-void planVulkanFFTAxis(VulkanFFTPlan* vulkanFFTPlan, uint32_t axis) {
+uint32_t vulkanFFTAxisSwapCount(VulkanFFTPlan* vulkanFFTPlan, uint32_t axis) {
+    // Passes of a planned axis which read one buffer of the plan and write the other, Bluestein axes work in their own buffers in between
     VulkanFFTAxis* vulkanFFTAxis = &vulkanFFTPlan->axes[axis];
+    uint32_t realPass = vulkanFFTPlan->realTransform && axis == 0;
+    return ((vulkanFFTAxis->bluesteinSampleCount || vulkanFFTAxis->sharedMemory) ? 1 : vulkanFFTAxis->stageCount) + realPass;
+}
 
-    {
-        vulkanFFTAxis->stageCount = 31-__builtin_clz(vulkanFFTAxis->sampleCount); // Logarithm of base 2
-        vulkanFFTAxis->stageRadix = (uint32_t*)malloc(sizeof(uint32_t) * vulkanFFTAxis->stageCount);
-        uint32_t stageSize = vulkanFFTAxis->sampleCount;
-        vulkanFFTAxis->stageCount = 0;
-        while(stageSize > 1) {
-            uint32_t radixIndex = SUPPORTED_RADIX_LEVELS;
-            do {
-                assert(radixIndex > 0);
-                --radixIndex;
-                vulkanFFTAxis->stageRadix[vulkanFFTAxis->stageCount] = 2<<radixIndex;
-            } while(stageSize % vulkanFFTAxis->stageRadix[vulkanFFTAxis->stageCount] > 0);
-            stageSize /= vulkanFFTAxis->stageRadix[vulkanFFTAxis->stageCount];
-            ++vulkanFFTAxis->stageCount;
-        }
+uint32_t vulkanFFTAxisOrder(VulkanFFTPlan* vulkanFFTPlan, uint32_t index) {
+    // Complex to real transforms have to reduce axis 0 to real values last
+    return (vulkanFFTPlan->realTransform && vulkanFFTPlan->inverse) ? COUNT_OF(vulkanFFTPlan->axes) - 1 - index : index;
+}
+
+bool vulkanFFTAxisIsTransformed(VulkanFFTPlan* vulkanFFTPlan, uint32_t axis) {
+    return !vulkanFFTPlan->axes[axis].skip && (vulkanFFTPlan->axes[axis].sampleCount > 1 || (vulkanFFTPlan->realTransform && axis == 0));
+}
+
+uint32_t vulkanFFTOuterAxis(VulkanFFTPlan* vulkanFFTPlan, bool last) {
+    // The first or last transformed axis in the order of the passes
+    uint32_t axis = COUNT_OF(vulkanFFTPlan->axes);
+    for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->axes); ++i)
+        if(vulkanFFTAxisIsTransformed(vulkanFFTPlan, vulkanFFTAxisOrder(vulkanFFTPlan, i)) && (last || axis == COUNT_OF(vulkanFFTPlan->axes)))
+            axis = vulkanFFTAxisOrder(vulkanFFTPlan, i);
+    return axis;
+}
+
+void dispatchVulkanFFTPass(VulkanFFTContext* context, VulkanFFTPass* pass, uint32_t invocationCount, uint32_t columnCount, uint32_t workGroupSize, bool coalesced) {
+    // Coalesced passes dispatch work groups of adjacent columns and one invocation per column along the axis
+    if(coalesced) {
+        pass->workGroupCount[0] = (columnCount + workGroupSize - 1) / workGroupSize;
+        pass->workGroupCount[1] = invocationCount;
+        assert(pass->workGroupCount[1] <= context->physicalDeviceProperties.limits.maxComputeWorkGroupCount[1]);
+    } else {
+        pass->workGroupCount[0] = (invocationCount + workGroupSize - 1) / workGroupSize;
+        pass->workGroupCount[1] = columnCount;
     }
+}
+
+uint32_t vulkanFFTSharedMemoryTileWidth(VulkanFFTContext* context, uint32_t fftSampleCount, uint32_t columnCount) {
+    // Coalesced shared memory passes transform up to a cache line of adjacent columns per work group, as far as shared memory and the work group limits allow
+    const VkPhysicalDeviceLimits* limits = &context->physicalDeviceProperties.limits;
+    uint32_t workGroupSize = (fftSampleCount + sharedMemoryValuesPerInvocation - 1) / sharedMemoryValuesPerInvocation, tileWidth = 1;
+    while(tileWidth < columnCount && tileWidth * 2 <= sharedMemoryMaxTileWidth &&
+          sizeof(float) * 2 * (fftSampleCount + 1) * tileWidth * 2 <= limits->maxComputeSharedMemorySize &&
+          workGroupSize * tileWidth * 2 <= limits->maxComputeWorkGroupInvocations &&
+          tileWidth * 2 <= limits->maxComputeWorkGroupSize[1])
+        tileWidth *= 2;
+    return tileWidth;
+}
+
+void createVulkanFFTAxis(VulkanFFTPlan* vulkanFFTPlan, uint32_t axis) {
+    VulkanFFTAxis* vulkanFFTAxis = &vulkanFFTPlan->axes[axis];
+    // Coalesced plans put the contiguous x axis into the second dimension of the dispatch of the other axes
+    const uint32_t remap[3][3] = {{0, 1, 2}, {1, (vulkanFFTPlan->coalesced) ? 0 : 2, (vulkanFFTPlan->coalesced) ? 2 : 0}, {2, 0, 1}};
+    // Real transforms store n/2+1 complex values per row and use a half length complex FFT along axis 0
+    bool realPass = vulkanFFTPlan->realTransform && axis == 0, coalesced = vulkanFFTPlan->coalesced && axis > 0;
+    uint32_t extent[3] = {vulkanFFTPlan->axes[0].sampleCount, vulkanFFTPlan->axes[1].sampleCount, vulkanFFTPlan->axes[2].sampleCount};
+    if(vulkanFFTPlan->realTransform)
+        extent[0] = extent[0] / 2 + 1;
+    uint32_t rowCount[2] = {extent[remap[axis][1]], extent[remap[axis][2]]};
+    uint32_t sampleCount = (realPass) ? vulkanFFTAxis->sampleCount / 2 : vulkanFFTAxis->sampleCount;
+    uint32_t fftSampleCount = (vulkanFFTAxis->bluesteinSampleCount) ? vulkanFFTAxis->bluesteinSampleCount : sampleCount;
+    uint32_t tileWidth = (coalesced && vulkanFFTAxis->sharedMemory) ? vulkanFFTSharedMemoryTileWidth(vulkanFFTPlan->context, fftSampleCount, rowCount[0]) : 1;
+    uint32_t fftPassCount, fftPipelineCount;
 
     {
-        vulkanFFTAxis->uboSize = vulkanFFTPlan->context->uboAlignment * vulkanFFTAxis->stageCount;
-        createBuffer(vulkanFFTPlan->context, &vulkanFFTAxis->ubo, &vulkanFFTAxis->uboDeviceMemory, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT, vulkanFFTAxis->uboSize);
+        fftPassCount = (vulkanFFTAxis->sharedMemory) ? 1 : vulkanFFTAxis->stageCount;
+        fftPipelineCount = (vulkanFFTAxis->sharedMemory) ? 1 : SUPPORTED_RADIX_COUNT;
+        // Bluestein: Chirp, forward FFT, multiply with kernel spectrum, inverse FFT, chirp
+        vulkanFFTAxis->passCount = ((vulkanFFTAxis->bluesteinSampleCount) ? fftPassCount * 2 + 3 : fftPassCount) + realPass;
+        vulkanFFTAxis->passes = (VulkanFFTPass*)malloc(sizeof(VulkanFFTPass) * vulkanFFTAxis->passCount);
+        vulkanFFTAxis->pipelineCount = ((vulkanFFTAxis->bluesteinSampleCount) ? fftPipelineCount + 3 : fftPipelineCount) + realPass;
+    }
+
+    if(vulkanFFTAxis->bluesteinSampleCount) {
+        for(uint32_t i = 0; i < COUNT_OF(vulkanFFTAxis->bluesteinBuffer); ++i)
+            allocateVulkanFFTBuffer(vulkanFFTPlan->context, &vulkanFFTAxis->bluesteinBuffer[i], VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(float) * 2 * vulkanFFTAxis->bluesteinSampleCount * rowCount[0] * rowCount[1] * vulkanFFTPlan->batchCount, (vulkanFFTPlan->shareScratch) ? &vulkanFFTPlan->scratchSize : NULL);
         VulkanFFTTransfer vulkanFFTTransfer;
         vulkanFFTTransfer.context = vulkanFFTPlan->context;
-        vulkanFFTTransfer.size = vulkanFFTAxis->uboSize;
-        vulkanFFTTransfer.deviceBuffer = vulkanFFTAxis->ubo;
-        char* ubo = createVulkanFFTUpload(&vulkanFFTTransfer);
-        const uint32_t remap[3][3] = {{0, 1, 2}, {1, 2, 0}, {2, 0, 1}};
-        uint32_t strides[3] = {1, vulkanFFTPlan->axes[0].sampleCount, vulkanFFTPlan->axes[0].sampleCount * vulkanFFTPlan->axes[1].sampleCount};
-        uint32_t stageSize = 1;
-        for(uint32_t j = 0; j < vulkanFFTAxis->stageCount; ++j) {
-            VulkanFFTUBO* uboFrame = (VulkanFFTUBO*)&ubo[vulkanFFTPlan->context->uboAlignment * j];
-            uboFrame->stride[0] = strides[remap[axis][0]];
-            uboFrame->stride[1] = strides[remap[axis][1]];
-            uboFrame->stride[2] = strides[remap[axis][2]];
-            uboFrame->radixStride = vulkanFFTAxis->sampleCount / vulkanFFTAxis->stageRadix[j];
-            uboFrame->stageSize = stageSize;
-            uboFrame->directionFactor = (vulkanFFTPlan->inverse) ? -1.0F : 1.0F;
-            uboFrame->angleFactor = uboFrame->directionFactor * (float) (M_PI / uboFrame->stageSize);
-            uboFrame->normalizationFactor = (vulkanFFTPlan->inverse) ? 1.0F : 1.0F / vulkanFFTAxis->stageRadix[j];
-            stageSize *= vulkanFFTAxis->stageRadix[j];
-        }
+        vulkanFFTTransfer.size = sizeof(float) * 2 * (sampleCount + vulkanFFTAxis->bluesteinSampleCount);
+        allocateVulkanFFTBuffer(vulkanFFTPlan->context, &vulkanFFTAxis->bluesteinTable, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, vulkanFFTTransfer.size, NULL);
+        vulkanFFTTransfer.deviceBuffer = vulkanFFTAxis->bluesteinTable;
+        fillVulkanFFTBluesteinTable((float*)createVulkanFFTUpload(&vulkanFFTTransfer), sampleCount, vulkanFFTAxis->bluesteinSampleCount, (vulkanFFTPlan->inverse) ? -1.0 : 1.0, 1.0);
         freeVulkanFFTTransfer(&vulkanFFTTransfer);
     }
 
+    VkBuffer (*passBuffers)[3] = (VkBuffer(*)[3])malloc(sizeof(VkBuffer[3]) * vulkanFFTAxis->passCount);
+    {
+        // The fourth stride separates the transforms of a batch
+        uint32_t strides[3] = {1, extent[0], extent[0] * extent[1]};
+        uint32_t dataStride[4] = {strides[remap[axis][0]], strides[remap[axis][1]], strides[remap[axis][2]], extent[0] * extent[1] * extent[2]};
+        uint32_t bluesteinStride[4] = {1, vulkanFFTAxis->bluesteinSampleCount, vulkanFFTAxis->bluesteinSampleCount * rowCount[0], vulkanFFTAxis->bluesteinSampleCount * rowCount[0] * rowCount[1]};
+        if(coalesced) {
+            // Interleave the columns in the Bluestein work buffers too
+            bluesteinStride[0] = rowCount[0];
+            bluesteinStride[1] = 1;
+        }
+        VkBuffer twiddleFactors = acquireVulkanFFTTwiddleFactors(vulkanFFTPlan->context, fftSampleCount);
+        // The real pass runs after the complex FFT when transforming forward and before it when transforming backward
+        uint32_t fftPassOffset = (realPass && vulkanFFTPlan->inverse) ? 1 : 0;
+        uint32_t fftPassTotal = vulkanFFTAxis->passCount - realPass;
+        bool swap = vulkanFFTPlan->resultInSwapBuffer;
+        // Work estimates for profiling: 5 n log2(n) flops per FFT, 6 per complex multiplication and every value is read and written once
+        double transformCount = (double)rowCount[0] * rowCount[1] * vulkanFFTPlan->batchCount;
+        for(uint32_t j = 0; j < vulkanFFTAxis->passCount; ++j) {
+            VulkanFFTPass* pass = &vulkanFFTAxis->passes[j];
+            VulkanFFTPushConstants* pushConstants = &pass->pushConstants;
+            memset(pushConstants, 0, sizeof(VulkanFFTPushConstants));
+            memset(&pass->profile, 0, sizeof(VulkanFFTProfile));
+            pass->workGroupCount[1] = rowCount[0];
+            pass->workGroupCount[2] = rowCount[1] * vulkanFFTPlan->batchCount;
+            assert(pass->workGroupCount[2] <= vulkanFFTPlan->context->physicalDeviceProperties.limits.maxComputeWorkGroupCount[2]);
+            pushConstants->rowCount = rowCount[1];
+            pushConstants->columnCount = rowCount[0];
+            const uint32_t* inputStride = dataStride;
+            const uint32_t* outputStride = dataStride;
+            bool inverse = vulkanFFTPlan->inverse;
+            uint32_t fftPass = j - fftPassOffset;
+            uint32_t stage = fftPass;
+            passBuffers[j][0] = vulkanFFTPlan->buffer[swap];
+            passBuffers[j][1] = vulkanFFTPlan->buffer[!swap];
+            passBuffers[j][2] = twiddleFactors;
+            pushConstants->directionFactor = (inverse) ? -1.0F : 1.0F;
+            pushConstants->normalizationFactor = 1.0F;
+            if(realPass && j == ((inverse) ? 0 : vulkanFFTAxis->passCount - 1)) {
+                pass->pipelineIndex = vulkanFFTAxis->pipelineCount - 1;
+                pass->workGroupCount[0] = (sampleCount / 2 + vulkanFFTAxis->workGroupSize) / vulkanFFTAxis->workGroupSize;
+                pass->profile.flopCount = 14.0 * sampleCount * transformCount;
+                pass->profile.byteCount = sizeof(float) * 4.0 * sampleCount * transformCount;
+                pushConstants->normalizationFactor = (inverse) ? 1.0F : 0.25F;
+                for(uint32_t i = 0; i < COUNT_OF(pushConstants->stride); ++i) {
+                    pushConstants->stride[i] = inputStride[i];
+                    pushConstants->outputStride[i] = outputStride[i];
+                }
+                swap = !swap;
+                continue;
+            }
+            if(vulkanFFTAxis->bluesteinSampleCount) {
+                inputStride = (fftPass == 0) ? dataStride : bluesteinStride;
+                outputStride = (fftPass == fftPassTotal - 1) ? dataStride : bluesteinStride;
+                if(fftPass > 0)
+                    passBuffers[j][0] = vulkanFFTAxis->bluesteinBuffer[(fftPass + 1) % 2];
+                if(fftPass < fftPassTotal - 1)
+                    passBuffers[j][1] = vulkanFFTAxis->bluesteinBuffer[fftPass % 2];
+                else
+                    swap = !swap;
+                for(uint32_t i = 0; i < COUNT_OF(pushConstants->stride); ++i) {
+                    pushConstants->stride[i] = inputStride[i];
+                    pushConstants->outputStride[i] = outputStride[i];
+                }
+                uint32_t bluesteinStep = (fftPass == 0) ? 0 : (fftPass == fftPassCount + 1) ? 1 : (fftPass == fftPassTotal - 1) ? 2 : 3;
+                if(bluesteinStep < 3) {
+                    uint32_t invocationCount = (bluesteinStep == 2) ? sampleCount : vulkanFFTAxis->bluesteinSampleCount;
+                    pass->pipelineIndex = fftPipelineCount + bluesteinStep;
+                    dispatchVulkanFFTPass(vulkanFFTPlan->context, pass, invocationCount, rowCount[0], vulkanFFTAxis->workGroupSize, coalesced);
+                    pass->profile.flopCount = 6.0 * invocationCount * transformCount;
+                    pass->profile.byteCount = sizeof(float) * 6.0 * invocationCount * transformCount;
+                    passBuffers[j][2] = vulkanFFTAxis->bluesteinTable;
+                    if(bluesteinStep == 2 && !inverse)
+                        pushConstants->normalizationFactor = 1.0F / sampleCount;
+                    continue;
+                }
+                // The convolution always uses a normalized forward and an unnormalized inverse FFT
+                inverse = fftPass > fftPassCount;
+                stage = (inverse) ? fftPass - fftPassCount - 2 : fftPass - 1;
+                pushConstants->directionFactor = (inverse) ? -1.0F : 1.0F;
+            } else
+                swap = !swap;
+            for(uint32_t i = 0; i < COUNT_OF(pushConstants->stride); ++i) {
+                pushConstants->stride[i] = inputStride[i];
+                pushConstants->outputStride[i] = outputStride[i];
+            }
+            if(vulkanFFTAxis->sharedMemory) {
+                pass->pipelineIndex = 0;
+                pass->workGroupCount[0] = 1;
+                pass->workGroupCount[1] = (rowCount[0] + tileWidth - 1) / tileWidth;
+                pass->profile.flopCount = 5.0 * fftSampleCount * log2(fftSampleCount) * transformCount;
+                pass->profile.byteCount = sizeof(float) * 4.0 * fftSampleCount * transformCount;
+                pushConstants->normalizationFactor = (inverse) ? 1.0F : 1.0F / fftSampleCount;
+                pushConstants->stageCount = vulkanFFTAxis->stageCount;
+                for(uint32_t i = 0; i < vulkanFFTAxis->stageCount; ++i)
+                    pushConstants->stageRadix[i / 8] |= vulkanFFTAxis->stageRadix[i] << (4 * (i % 8));
+                continue;
+            }
+            uint32_t stageSize = 1;
+            for(uint32_t i = 0; i < stage; ++i)
+                stageSize *= vulkanFFTAxis->stageRadix[i];
+            pass->pipelineIndex = 0;
+            while(supportedRadix[pass->pipelineIndex] != vulkanFFTAxis->stageRadix[stage])
+                ++pass->pipelineIndex;
+            pushConstants->radixStride = fftSampleCount / vulkanFFTAxis->stageRadix[stage];
+            pushConstants->stageSize = stageSize;
+            pushConstants->normalizationFactor = (inverse) ? 1.0F : 1.0F / vulkanFFTAxis->stageRadix[stage];
+            dispatchVulkanFFTPass(vulkanFFTPlan->context, pass, pushConstants->radixStride, rowCount[0], vulkanFFTAxis->workGroupSize, coalesced);
+            pass->profile.flopCount = 5.0 * fftSampleCount * log2(vulkanFFTAxis->stageRadix[stage]) * transformCount;
+            pass->profile.byteCount = sizeof(float) * 4.0 * fftSampleCount * transformCount;
+        }
+        vulkanFFTPlan->resultInSwapBuffer = swap && !vulkanFFTPlan->inPlace;
+    }
+
+    {
+        // The first pass of the plan reads directly from the input buffer of the user and the last pass writes directly to the output buffer of the user
+        const VulkanFFTBufferLayout* layouts[2] = {&vulkanFFTPlan->input, &vulkanFFTPlan->output};
+        for(uint32_t i = 0; i < COUNT_OF(layouts); ++i) {
+            if(!layouts[i]->buffer || vulkanFFTOuterAxis(vulkanFFTPlan, i == 1) != axis)
+                continue;
+            uint32_t j = (i == 0) ? 0 : vulkanFFTAxis->passCount - 1;
+            VulkanFFTPushConstants* pushConstants = &vulkanFFTAxis->passes[j].pushConstants;
+            uint32_t* stride = (i == 0) ? pushConstants->stride : pushConstants->outputStride;
+            if(layouts[i]->stride[0] || layouts[i]->stride[1] || layouts[i]->stride[2] || layouts[i]->stride[3]) {
+                for(uint32_t k = 0; k < 3; ++k)
+                    stride[k] = layouts[i]->stride[remap[axis][k]];
+                stride[3] = layouts[i]->stride[3];
+            }
+            // Separate planes are only supported for complex single precision data
+            assert(!layouts[i]->planeOffset || (!vulkanFFTPlan->realTransform && !vulkanFFTPlan->halfPrecision));
+            VkDeviceSize valueSize = (layouts[i]->planeOffset) ? sizeof(float) : ((vulkanFFTPlan->halfPrecision) ? sizeof(uint16_t) : sizeof(float)) * 2;
+            assert(layouts[i]->offset % valueSize == 0);
+            pushConstants->offset[i] = (uint32_t)(layouts[i]->offset / valueSize);
+            pushConstants->planeOffset[i] = layouts[i]->planeOffset;
+            passBuffers[j][i] = layouts[i]->buffer;
+        }
+    }
+
+    if(vulkanFFTPlan->halfPrecision)
+        // Only the buffers of the plan and the user are stored in half precision, Bluestein work buffers stay in single precision
+        for(uint32_t j = 0; j < vulkanFFTAxis->passCount; ++j) {
+            VulkanFFTPass* pass = &vulkanFFTAxis->passes[j];
+            double byteCount = pass->profile.byteCount;
+            for(uint32_t i = 0; i < 2; ++i)
+                if(passBuffers[j][i] == vulkanFFTPlan->buffer[0] || passBuffers[j][i] == vulkanFFTPlan->buffer[1] || passBuffers[j][i] == vulkanFFTPlan->input.buffer || passBuffers[j][i] == vulkanFFTPlan->output.buffer) {
+                    pass->pushConstants.halfPrecision |= 1 << i;
+                    pass->profile.byteCount -= byteCount * 0.25;
+                }
+        }
+
     {
-        VkDescriptorPoolSize descriptorPoolSize[2] = {0};
-        descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorPoolSize[0].descriptorCount = vulkanFFTAxis->stageCount;
-        descriptorPoolSize[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorPoolSize[1].descriptorCount = vulkanFFTAxis->stageCount*2;
+        VkDescriptorPoolSize descriptorPoolSize = {0};
+        descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorPoolSize.descriptorCount = COUNT_OF(vulkanFFTAxis->descriptorSets) * 2;
         VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {0};
         descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        descriptorPoolCreateInfo.poolSizeCount = COUNT_OF(descriptorPoolSize);
-        descriptorPoolCreateInfo.pPoolSizes = descriptorPoolSize;
-        descriptorPoolCreateInfo.maxSets = vulkanFFTAxis->stageCount;
+        descriptorPoolCreateInfo.poolSizeCount = 1;
+        descriptorPoolCreateInfo.pPoolSizes = &descriptorPoolSize;
+        descriptorPoolCreateInfo.maxSets = COUNT_OF(vulkanFFTAxis->descriptorSets);
         assert(vkCreateDescriptorPool(vulkanFFTPlan->context->device, &descriptorPoolCreateInfo, vulkanFFTPlan->context->allocator, &vulkanFFTAxis->descriptorPool) == VK_SUCCESS);
     }
 
     {
-        const VkDescriptorType descriptorType[] = {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER};
-        vulkanFFTAxis->descriptorSetLayouts = (VkDescriptorSetLayout*)malloc(sizeof(VkDescriptorSetLayout) * vulkanFFTAxis->stageCount);
-        vulkanFFTAxis->descriptorSets = (VkDescriptorSet*)malloc(sizeof(VkDescriptorSet) * vulkanFFTAxis->stageCount);
-        VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[COUNT_OF(descriptorType)];
-        for(uint32_t i = 0; i < COUNT_OF(descriptorSetLayoutBindings); ++i) {
-            descriptorSetLayoutBindings[i].binding = i;
-            descriptorSetLayoutBindings[i].descriptorType = descriptorType[i];
-            descriptorSetLayoutBindings[i].descriptorCount = 1;
-            descriptorSetLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        // Passes between the ping-pong buffers use the descriptor sets of the plan,
+        // the axis only needs sets for its lookup tables and the Bluestein work buffers
+        VkBuffer descriptorSetBuffers[COUNT_OF(vulkanFFTAxis->descriptorSets)][2];
+        vulkanFFTAxis->descriptorSetCount = 0;
+        for(uint32_t j = 0; j < vulkanFFTAxis->passCount; ++j)
+            for(uint32_t set = 0; set < COUNT_OF(vulkanFFTAxis->passes[j].descriptorSets); ++set) {
+                VkBuffer buffers[2] = {passBuffers[j][set * 2], (set == 0) ? passBuffers[j][1] : VK_NULL_HANDLE};
+                VkDescriptorSet* descriptorSet = &vulkanFFTAxis->passes[j].descriptorSets[set];
+                if(set == 0 && buffers[0] == vulkanFFTPlan->buffer[0] && buffers[1] == vulkanFFTPlan->buffer[1]) {
+                    *descriptorSet = vulkanFFTPlan->descriptorSets[0];
+                    continue;
+                }
+                if(set == 0 && buffers[0] == vulkanFFTPlan->buffer[1] && buffers[1] == vulkanFFTPlan->buffer[0]) {
+                    *descriptorSet = vulkanFFTPlan->descriptorSets[1];
+                    continue;
+                }
+                uint32_t i = 0;
+                while(i < vulkanFFTAxis->descriptorSetCount && memcmp(descriptorSetBuffers[i], buffers, sizeof(buffers)) != 0)
+                    ++i;
+                if(i == vulkanFFTAxis->descriptorSetCount) {
+                    assert(i < COUNT_OF(vulkanFFTAxis->descriptorSets));
+                    memcpy(descriptorSetBuffers[i], buffers, sizeof(buffers));
+                    vulkanFFTAxis->descriptorSets[i] = createVulkanFFTDescriptorSet(vulkanFFTPlan->context, vulkanFFTAxis->descriptorPool, set, buffers);
+                    ++vulkanFFTAxis->descriptorSetCount;
+                }
+                *descriptorSet = vulkanFFTAxis->descriptorSets[i];
+            }
+    }
+    free(passBuffers);
+
+    {
+        // Pipelines are shared with all other axes and plans of the context, only radices which are used are acquired
+        vulkanFFTAxis->pipelines = (VkPipeline*)malloc(sizeof(VkPipeline) * vulkanFFTAxis->pipelineCount);
+        for(uint32_t i = 0; i < vulkanFFTAxis->pipelineCount; ++i) {
+            uint32_t specializationData[VULKAN_FFT_SPECIALIZATION_CONSTANT_COUNT];
+            specializationData[0] = vulkanFFTAxis->workGroupSize;
+            specializationData[1] = sampleCount;
+            specializationData[2] = !vulkanFFTPlan->computeTwiddleFactors;
+            specializationData[3] = vulkanFFTAxis->bluesteinSampleCount;
+            specializationData[4] = 0;
+            specializationData[5] = coalesced;
+            specializationData[6] = 1;
+            specializationData[7] = 0;
+            VkShaderModule shaderModule;
+            if(realPass && i == vulkanFFTAxis->pipelineCount - 1) {
+                specializationData[1] = vulkanFFTAxis->sampleCount;
+                specializationData[5] = false;
+                shaderModule = vulkanFFTPlan->context->realTransformShaderModule;
+            } else if(i >= fftPipelineCount) {
+                specializationData[4] = i - fftPipelineCount;
+                shaderModule = vulkanFFTPlan->context->bluesteinShaderModule;
+            } else if(vulkanFFTAxis->sharedMemory) {
+                specializationData[0] = (fftSampleCount + sharedMemoryValuesPerInvocation - 1) / sharedMemoryValuesPerInvocation;
+                specializationData[1] = fftSampleCount;
+                specializationData[5] = false;
+                // Tiles of more than one column pad every column by one value against bank conflicts
+                specializationData[6] = tileWidth;
+                specializationData[7] = (tileWidth > 1) ? fftSampleCount + 1 : fftSampleCount;
+                shaderModule = vulkanFFTPlan->context->sharedMemoryShaderModule;
+            } else {
+                bool used = false;
+                for(uint32_t j = 0; j < vulkanFFTAxis->stageCount; ++j)
+                    used = used || vulkanFFTAxis->stageRadix[j] == supportedRadix[i];
+                vulkanFFTAxis->pipelines[i] = VK_NULL_HANDLE;
+                if(!used)
+                    continue;
+                specializationData[1] = fftSampleCount;
+                shaderModule = vulkanFFTPlan->context->shaderModules[i];
+            }
+            vulkanFFTAxis->pipelines[i] = acquireVulkanFFTPipeline(vulkanFFTPlan->context, shaderModule, specializationData);
+        }
+    }
+}
+
+void recordVulkanFFTAxis(VulkanFFTPlan* vulkanFFTPlan, uint32_t axis, VkCommandBuffer commandBuffer) {
+    VulkanFFTAxis* vulkanFFTAxis = &vulkanFFTPlan->axes[axis];
+    VkMemoryBarrier memoryBarrier = {0};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    for(uint32_t j = 0; j < vulkanFFTAxis->passCount; ++j) {
+        VulkanFFTPass* pass = &vulkanFFTAxis->passes[j];
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vulkanFFTAxis->pipelines[pass->pipelineIndex]);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vulkanFFTPlan->context->pipelineLayout, 0, COUNT_OF(pass->descriptorSets), pass->descriptorSets, 0, NULL);
+        vkCmdPushConstants(commandBuffer, vulkanFFTPlan->context->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(VulkanFFTPushConstants), &pass->pushConstants);
+        vkCmdDispatch(commandBuffer, pass->workGroupCount[0], pass->workGroupCount[1], pass->workGroupCount[2]);
+        // Passes only wait for passes, so that transfers recorded around them are not serialized with them
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_DEPENDENCY_BY_REGION_BIT, 1, &memoryBarrier, 0, NULL, 0, NULL);
+        if(vulkanFFTPlan->queryPool)
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, vulkanFFTPlan->queryPool, vulkanFFTAxis->firstQuery + 1 + j);
+    }
+}
+
+void destroyVulkanFFTAxis(VulkanFFTPlan* vulkanFFTPlan, uint32_t axis) {
+    VulkanFFTAxis* vulkanFFTAxis = &vulkanFFTPlan->axes[axis];
+    uint32_t sampleCount = (vulkanFFTPlan->realTransform && axis == 0) ? vulkanFFTAxis->sampleCount / 2 : vulkanFFTAxis->sampleCount;
+    releaseVulkanFFTTwiddleFactors(vulkanFFTPlan->context, (vulkanFFTAxis->bluesteinSampleCount) ? vulkanFFTAxis->bluesteinSampleCount : sampleCount);
+    if(vulkanFFTAxis->bluesteinSampleCount) {
+        for(uint32_t j = 0; j < COUNT_OF(vulkanFFTAxis->bluesteinBuffer); ++j)
+            freeVulkanFFTBuffer(vulkanFFTPlan->context, vulkanFFTAxis->bluesteinBuffer[j]);
+        freeVulkanFFTBuffer(vulkanFFTPlan->context, vulkanFFTAxis->bluesteinTable);
+    }
+    vkDestroyDescriptorPool(vulkanFFTPlan->context->device, vulkanFFTAxis->descriptorPool, vulkanFFTPlan->context->allocator);
+    for(uint32_t j = 0; j < vulkanFFTAxis->pipelineCount; ++j)
+        if(vulkanFFTAxis->pipelines[j])
+            releaseVulkanFFTPipeline(vulkanFFTPlan->context, vulkanFFTAxis->pipelines[j]);
+    free(vulkanFFTAxis->pipelines);
+    free(vulkanFFTAxis->passes);
+}
+
+void createVulkanFFTBuffers(VulkanFFTPlan* vulkanFFTPlan, uint32_t swapCount) {
+    // In place plans alias both buffers, so every pass reads and writes the same one.
+    // With buffers of the user for input and output the buffers of the plan only hold intermediate results: The first of the swapCount passes reads the input,
+    // the last one writes the output and pass k in between reads buffer[(k - 1) % 2]. So up to two passes only need the buffer read by the last pass,
+    // more passes use a dense output buffer of the user as the other buffer, as the last pass does not read it.
+    const VulkanFFTBufferLayout* output = &vulkanFFTPlan->output;
+    bool userBuffers = vulkanFFTPlan->input.buffer && output->buffer && !vulkanFFTPlan->inPlace;
+    bool denseOutput = output->buffer != vulkanFFTPlan->input.buffer && output->offset == 0 && output->planeOffset == 0 && !output->stride[0] && !output->stride[1] && !output->stride[2] && !output->stride[3];
+    uint32_t last = (userBuffers) ? (swapCount + 1) % 2 : 0;
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    VkDeviceSize* scratchOffset = (vulkanFFTPlan->shareScratch && userBuffers) ? &vulkanFFTPlan->scratchSize : NULL;
+    allocateVulkanFFTBuffer(vulkanFFTPlan->context, &vulkanFFTPlan->buffer[last], usage, vulkanFFTPlan->bufferSize, scratchOffset);
+    if(vulkanFFTPlan->inPlace || (userBuffers && swapCount <= 2))
+        vulkanFFTPlan->buffer[!last] = vulkanFFTPlan->buffer[last];
+    else if(userBuffers && denseOutput)
+        vulkanFFTPlan->buffer[!last] = output->buffer;
+    else
+        allocateVulkanFFTBuffer(vulkanFFTPlan->context, &vulkanFFTPlan->buffer[!last], usage, vulkanFFTPlan->bufferSize, scratchOffset);
+    // Descriptor set i reads from buffer i and writes to the other one
+    VkDescriptorPoolSize descriptorPoolSize = {0};
+    descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorPoolSize.descriptorCount = COUNT_OF(vulkanFFTPlan->descriptorSets) * 2;
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {0};
+    descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCreateInfo.poolSizeCount = 1;
+    descriptorPoolCreateInfo.pPoolSizes = &descriptorPoolSize;
+    descriptorPoolCreateInfo.maxSets = COUNT_OF(vulkanFFTPlan->descriptorSets);
+    assert(vkCreateDescriptorPool(vulkanFFTPlan->context->device, &descriptorPoolCreateInfo, vulkanFFTPlan->context->allocator, &vulkanFFTPlan->descriptorPool) == VK_SUCCESS);
+    for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->descriptorSets); ++i) {
+        VkBuffer buffers[2] = {vulkanFFTPlan->buffer[i], vulkanFFTPlan->buffer[!i]};
+        vulkanFFTPlan->descriptorSets[i] = createVulkanFFTDescriptorSet(vulkanFFTPlan->context, vulkanFFTPlan->descriptorPool, 0, buffers);
+    }
+}
+
+void destroyVulkanFFTBuffers(VulkanFFTPlan* vulkanFFTPlan) {
+    // Aliased buffers and the output buffer of the user are not owned by the plan
+    vkDestroyDescriptorPool(vulkanFFTPlan->context->device, vulkanFFTPlan->descriptorPool, vulkanFFTPlan->context->allocator);
+    for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->buffer); ++i)
+        if(vulkanFFTPlan->buffer[i] != vulkanFFTPlan->output.buffer && (i == 0 || vulkanFFTPlan->buffer[i] != vulkanFFTPlan->buffer[0]))
+            freeVulkanFFTBuffer(vulkanFFTPlan->context, vulkanFFTPlan->buffer[i]);
+}
+
+double measureVulkanFFTAxis(VulkanFFTPlan* vulkanFFTPlan, uint32_t axis, VkQueryPool queryPool) {
+    bool resultInSwapBuffer = vulkanFFTPlan->resultInSwapBuffer;
+    VkDeviceSize scratchSize = vulkanFFTPlan->scratchSize;
+    createVulkanFFTAxis(vulkanFFTPlan, axis);
+    VkCommandBuffer commandBuffer = createCommandBuffer(vulkanFFTPlan->context, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+    // The first repetition warms up the caches and is not measured
+    recordVulkanFFTAxis(vulkanFFTPlan, axis, commandBuffer);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+    for(uint32_t i = 0; i < measureRepetitions; ++i)
+        recordVulkanFFTAxis(vulkanFFTPlan, axis, commandBuffer);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+    vkEndCommandBuffer(commandBuffer);
+    executeCommandBuffer(vulkanFFTPlan->context, commandBuffer);
+    uint64_t timestamps[2];
+    assert(vkGetQueryPoolResults(vulkanFFTPlan->context->device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) == VK_SUCCESS);
+    destroyVulkanFFTAxis(vulkanFFTPlan, axis);
+    vulkanFFTPlan->resultInSwapBuffer = resultInSwapBuffer;
+    vulkanFFTPlan->scratchSize = scratchSize;
+    return (double)(timestamps[1] - timestamps[0]) * vulkanFFTPlan->context->physicalDeviceProperties.limits.timestampPeriod;
+}
+
+void measureVulkanFFTAxisCandidates(VulkanFFTPlan* vulkanFFTPlan, uint32_t axis, uint32_t fftSampleCount, uint32_t requestedMaxRadix, bool sharedMemoryFits) {
+    // The candidates run on a copy of the plan with buffers of its own, so the buffers of the user are never overwritten
+    VulkanFFTPlan measurePlan = *vulkanFFTPlan;
+    measurePlan.input.buffer = VK_NULL_HANDLE;
+    measurePlan.output.buffer = VK_NULL_HANDLE;
+    createVulkanFFTBuffers(&measurePlan, 0);
+    VulkanFFTAxis* vulkanFFTAxis = &measurePlan.axes[axis];
+    VkQueryPoolCreateInfo queryPoolCreateInfo = {0};
+    queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolCreateInfo.queryCount = 2;
+    VkQueryPool queryPool;
+    assert(vkCreateQueryPool(vulkanFFTPlan->context->device, &queryPoolCreateInfo, vulkanFFTPlan->context->allocator, &queryPool) == VK_SUCCESS);
+    const VkPhysicalDeviceLimits* limits = &vulkanFFTPlan->context->physicalDeviceProperties.limits;
+    double bestTime = INFINITY;
+    uint32_t bestStageRadix[MAX_STAGE_COUNT], bestStageCount = 0, bestWorkGroupSize = defaultWorkGroupSize, previousStageRadix[MAX_STAGE_COUNT], previousStageCount = 0;
+    bool bestSharedMemory = sharedMemoryFits;
+    // Candidates: Factorizations limited to the requested maxRadix or a smaller power of two, in descending and ascending order, with and without shared memory, and various work group sizes
+    for(uint32_t maxRadix = requestedMaxRadix; maxRadix >= 2; maxRadix /= 2) {
+        uint32_t stageRadix[MAX_STAGE_COUNT];
+        uint32_t stageCount = factorizeSampleCount(fftSampleCount, maxRadix, stageRadix);
+        if(stageCount == 0 || (stageCount == previousStageCount && memcmp(stageRadix, previousStageRadix, sizeof(uint32_t) * stageCount) == 0))
+            continue;
+        previousStageCount = stageCount;
+        memcpy(previousStageRadix, stageRadix, sizeof(uint32_t) * stageCount);
+        for(uint32_t order = 0; order < 2; ++order) {
+            bool palindrome = true;
+            for(uint32_t i = 0; i < stageCount / 2; ++i) {
+                palindrome = palindrome && stageRadix[i] == stageRadix[stageCount - 1 - i];
+                if(order == 1) {
+                    uint32_t aux = stageRadix[i];
+                    stageRadix[i] = stageRadix[stageCount - 1 - i];
+                    stageRadix[stageCount - 1 - i] = aux;
+                }
+            }
+            if(order == 1 && palindrome)
+                break;
+            vulkanFFTAxis->stageCount = stageCount;
+            memcpy(vulkanFFTAxis->stageRadix, stageRadix, sizeof(uint32_t) * stageCount);
+            for(uint32_t sharedMemory = 0; sharedMemory < 2; ++sharedMemory) {
+                if((sharedMemory && (!sharedMemoryFits || stageCount > SHARED_MEMORY_MAX_STAGES)) || (!sharedMemory && vulkanFFTPlan->inPlace))
+                    continue;
+                vulkanFFTAxis->sharedMemory = sharedMemory;
+                for(uint32_t i = 0; i < COUNT_OF(measureWorkGroupSizes); ++i) {
+                    // The shared memory kernel derives its work group size from the row length
+                    if((sharedMemory && i > 0 && !vulkanFFTAxis->bluesteinSampleCount) || measureWorkGroupSizes[i] > limits->maxComputeWorkGroupSize[0] || measureWorkGroupSizes[i] > limits->maxComputeWorkGroupInvocations)
+                        break;
+                    vulkanFFTAxis->workGroupSize = measureWorkGroupSizes[i];
+                    double time = measureVulkanFFTAxis(&measurePlan, axis, queryPool);
+                    if(time < bestTime) {
+                        bestTime = time;
+                        bestStageCount = stageCount;
+                        memcpy(bestStageRadix, stageRadix, sizeof(uint32_t) * stageCount);
+                        bestSharedMemory = sharedMemory;
+                        bestWorkGroupSize = measureWorkGroupSizes[i];
+                    }
+                }
+            }
         }
-        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {0};
-        descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        descriptorSetLayoutCreateInfo.bindingCount = COUNT_OF(descriptorSetLayoutBindings);
-        descriptorSetLayoutCreateInfo.pBindings = descriptorSetLayoutBindings;
-        assert(vkCreateDescriptorSetLayout(vulkanFFTPlan->context->device, &descriptorSetLayoutCreateInfo, vulkanFFTPlan->context->allocator, &vulkanFFTAxis->descriptorSetLayouts[0]) == VK_SUCCESS);
-        for(uint32_t j = 1; j < vulkanFFTAxis->stageCount; ++j)
-            vulkanFFTAxis->descriptorSetLayouts[j] = vulkanFFTAxis->descriptorSetLayouts[0];
-        VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {0};
-        descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        descriptorSetAllocateInfo.descriptorPool = vulkanFFTAxis->descriptorPool;
-        descriptorSetAllocateInfo.descriptorSetCount = vulkanFFTAxis->stageCount;
-        descriptorSetAllocateInfo.pSetLayouts = vulkanFFTAxis->descriptorSetLayouts;
-        assert(vkAllocateDescriptorSets(vulkanFFTPlan->context->device, &descriptorSetAllocateInfo, vulkanFFTAxis->descriptorSets) == VK_SUCCESS);
-        for(uint32_t j = 0; j < vulkanFFTAxis->stageCount; ++j)
-            for(uint32_t i = 0; i < COUNT_OF(descriptorType); ++i) {
-                VkDescriptorBufferInfo descriptorBufferInfo = {0};
-                if(i == 0) {
-                    descriptorBufferInfo.buffer = vulkanFFTAxis->ubo;
-                    descriptorBufferInfo.offset = vulkanFFTPlan->context->uboAlignment * j;
-                    descriptorBufferInfo.range = sizeof(VulkanFFTUBO);
-                } else {
-                    descriptorBufferInfo.buffer = vulkanFFTPlan->buffer[1 - (vulkanFFTPlan->resultInSwapBuffer + i + j) % 2];
-                    descriptorBufferInfo.offset = 0;
-                    descriptorBufferInfo.range = vulkanFFTPlan->bufferSize;
+    }
+    vkDestroyQueryPool(vulkanFFTPlan->context->device, queryPool, vulkanFFTPlan->context->allocator);
+    destroyVulkanFFTBuffers(&measurePlan);
+    vulkanFFTAxis = &vulkanFFTPlan->axes[axis];
+    vulkanFFTAxis->stageCount = bestStageCount;
+    memcpy(vulkanFFTAxis->stageRadix, bestStageRadix, sizeof(uint32_t) * bestStageCount);
+    vulkanFFTAxis->sharedMemory = bestSharedMemory;
+    vulkanFFTAxis->workGroupSize = bestWorkGroupSize;
+}
+
+void factorizeVulkanFFTAxis(VulkanFFTAxis* vulkanFFTAxis, uint32_t sampleCount, uint32_t maxRadix) {
+    vulkanFFTAxis->stageRadix = (uint32_t*)malloc(sizeof(uint32_t) * MAX_STAGE_COUNT);
+    vulkanFFTAxis->stageCount = factorizeSampleCount(sampleCount, maxRadix, vulkanFFTAxis->stageRadix);
+    vulkanFFTAxis->bluesteinSampleCount = 0;
+    if(vulkanFFTAxis->stageCount == 0 && sampleCount > 1) {
+        // Large prime factors: Convolve with a chirp using a power of two FFT (Bluestein)
+        vulkanFFTAxis->bluesteinSampleCount = 1;
+        while(vulkanFFTAxis->bluesteinSampleCount < sampleCount * 2 - 1)
+            vulkanFFTAxis->bluesteinSampleCount <<= 1;
+        vulkanFFTAxis->stageCount = factorizeSampleCount(vulkanFFTAxis->bluesteinSampleCount, maxRadix, vulkanFFTAxis->stageRadix);
+    }
+}
+
+bool vulkanFFTSharedMemoryFits(VulkanFFTContext* context, uint32_t fftSampleCount) {
+    // Rows which fit into shared memory are transformed in a single pass
+    const VkPhysicalDeviceLimits* limits = &context->physicalDeviceProperties.limits;
+    uint32_t sharedMemoryWorkGroupSize = (fftSampleCount + sharedMemoryValuesPerInvocation - 1) / sharedMemoryValuesPerInvocation;
+    return sizeof(float) * 2 * fftSampleCount <= limits->maxComputeSharedMemorySize &&
+        sharedMemoryWorkGroupSize <= limits->maxComputeWorkGroupSize[0] &&
+        sharedMemoryWorkGroupSize <= limits->maxComputeWorkGroupInvocations;
+}
+
+bool vulkanFFTAxisFitsInPlace(VulkanFFTPlan* vulkanFFTPlan, uint32_t axis) {
+    // Only the shared memory kernel can read and write a row in place, the multi-pass kernels need the swap buffer.
+    // Bluestein axes are rejected as well, as their padded rows need two scratch buffers of the whole volume which would defeat the point of a single buffer.
+    VulkanFFTAxis vulkanFFTAxis = vulkanFFTPlan->axes[axis];
+    uint32_t sampleCount = (vulkanFFTPlan->realTransform && axis == 0) ? vulkanFFTAxis.sampleCount / 2 : vulkanFFTAxis.sampleCount;
+    factorizeVulkanFFTAxis(&vulkanFFTAxis, sampleCount, (vulkanFFTPlan->maxRadix) ? vulkanFFTPlan->maxRadix : 8);
+    free(vulkanFFTAxis.stageRadix);
+    return vulkanFFTAxis.bluesteinSampleCount == 0 && vulkanFFTSharedMemoryFits(vulkanFFTPlan->context, sampleCount) && vulkanFFTAxis.stageCount <= SHARED_MEMORY_MAX_STAGES;
+}
+
+void planVulkanFFTAxis(VulkanFFTPlan* vulkanFFTPlan, uint32_t axis) {
+    VulkanFFTAxis* vulkanFFTAxis = &vulkanFFTPlan->axes[axis];
+    // Coalesced plans put the contiguous x axis into the second dimension of the dispatch of the other axes
+    const uint32_t remap[3][3] = {{0, 1, 2}, {1, (vulkanFFTPlan->coalesced) ? 0 : 2, (vulkanFFTPlan->coalesced) ? 2 : 0}, {2, 0, 1}};
+    bool realPass = vulkanFFTPlan->realTransform && axis == 0;
+    uint32_t extent[3] = {vulkanFFTPlan->axes[0].sampleCount, vulkanFFTPlan->axes[1].sampleCount, vulkanFFTPlan->axes[2].sampleCount};
+    if(vulkanFFTPlan->realTransform)
+        extent[0] = extent[0] / 2 + 1;
+    uint32_t sampleCount = (realPass) ? vulkanFFTAxis->sampleCount / 2 : vulkanFFTAxis->sampleCount;
+    uint32_t maxRadix = (vulkanFFTPlan->maxRadix) ? vulkanFFTPlan->maxRadix : 8;
+    factorizeVulkanFFTAxis(vulkanFFTAxis, sampleCount, maxRadix);
+    uint32_t fftSampleCount = (vulkanFFTAxis->bluesteinSampleCount) ? vulkanFFTAxis->bluesteinSampleCount : sampleCount;
+    const VkPhysicalDeviceLimits* limits = &vulkanFFTPlan->context->physicalDeviceProperties.limits;
+    bool sharedMemoryFits = vulkanFFTSharedMemoryFits(vulkanFFTPlan->context, fftSampleCount);
+    vulkanFFTAxis->sharedMemory = sharedMemoryFits && vulkanFFTAxis->stageCount <= SHARED_MEMORY_MAX_STAGES;
+    vulkanFFTAxis->workGroupSize = defaultWorkGroupSize;
+
+    // Use the wisdom of earlier measurements, or measure now and remember the fastest candidate
+    VulkanFFTWisdom key = {0};
+    // Coalesced axes are remembered separately
+    key.axis = (vulkanFFTPlan->coalesced && axis > 0) ? axis + COUNT_OF(vulkanFFTPlan->axes) : axis;
+    key.sampleCount = fftSampleCount;
+    key.rowCount[0] = extent[remap[axis][1]];
+    key.rowCount[1] = extent[remap[axis][2]] * vulkanFFTPlan->batchCount;
+    key.maxRadix = maxRadix;
+    key.inPlace = vulkanFFTPlan->inPlace;
+    VulkanFFTWisdom* wisdom = NULL;
+    for(uint32_t i = 0; i < vulkanFFTPlan->context->wisdomCount; ++i)
+        if(memcmp(&vulkanFFTPlan->context->wisdom[i], &key, offsetof(VulkanFFTWisdom, sharedMemory)) == 0 && (sharedMemoryFits || !vulkanFFTPlan->context->wisdom[i].sharedMemory))
+            wisdom = &vulkanFFTPlan->context->wisdom[i];
+    if(!wisdom && vulkanFFTPlan->measure && limits->timestampComputeAndGraphics && fftSampleCount > 1) {
+        measureVulkanFFTAxisCandidates(vulkanFFTPlan, axis, fftSampleCount, maxRadix, sharedMemoryFits);
+        vulkanFFTPlan->context->wisdom = (VulkanFFTWisdom*)realloc(vulkanFFTPlan->context->wisdom, sizeof(VulkanFFTWisdom) * (vulkanFFTPlan->context->wisdomCount + 1));
+        wisdom = &vulkanFFTPlan->context->wisdom[vulkanFFTPlan->context->wisdomCount++];
+        *wisdom = key;
+        wisdom->sharedMemory = vulkanFFTAxis->sharedMemory;
+        wisdom->workGroupSize = vulkanFFTAxis->workGroupSize;
+        wisdom->stageCount = vulkanFFTAxis->stageCount;
+        memcpy(wisdom->stageRadix, vulkanFFTAxis->stageRadix, sizeof(uint32_t) * vulkanFFTAxis->stageCount);
+    } else if(wisdom) {
+        vulkanFFTAxis->sharedMemory = wisdom->sharedMemory;
+        vulkanFFTAxis->workGroupSize = wisdom->workGroupSize;
+        vulkanFFTAxis->stageCount = wisdom->stageCount;
+        memcpy(vulkanFFTAxis->stageRadix, wisdom->stageRadix, sizeof(uint32_t) * wisdom->stageCount);
+    }
+    // Checked by createVulkanFFT, the wisdom of in place plans always uses shared memory
+    assert(!vulkanFFTPlan->inPlace || vulkanFFTAxis->sharedMemory);
+}
+
+static inline HostVector hostVectorLoad(const float* values) {
+#if defined(__AVX__)
+    return _mm256_loadu_ps(values);
+#elif defined(__ARM_NEON)
+    return vld1q_f32(values);
+#else
+    HostVector result;
+    memcpy(result.values, values, sizeof(result.values));
+    return result;
+#endif
+}
+
+static inline void hostVectorStore(float* values, HostVector a) {
+#if defined(__AVX__)
+    _mm256_storeu_ps(values, a);
+#elif defined(__ARM_NEON)
+    vst1q_f32(values, a);
+#else
+    memcpy(values, a.values, sizeof(a.values));
+#endif
+}
+
+static inline HostVector hostVectorAdd(HostVector a, HostVector b) {
+#if defined(__AVX__)
+    return _mm256_add_ps(a, b);
+#elif defined(__ARM_NEON)
+    return vaddq_f32(a, b);
+#else
+    for(uint32_t i = 0; i < HOST_LANE_COUNT * 2; ++i)
+        a.values[i] += b.values[i];
+    return a;
+#endif
+}
+
+static inline HostVector hostVectorSubtract(HostVector a, HostVector b) {
+#if defined(__AVX__)
+    return _mm256_sub_ps(a, b);
+#elif defined(__ARM_NEON)
+    return vsubq_f32(a, b);
+#else
+    for(uint32_t i = 0; i < HOST_LANE_COUNT * 2; ++i)
+        a.values[i] -= b.values[i];
+    return a;
+#endif
+}
+
+// Multiplies every lane with the same complex number
+static inline HostVector hostVectorMultiply(HostVector a, float real, float imag) {
+#if defined(__AVX__)
+    HostVector swapped = _mm256_permute_ps(a, 0xB1);
+    return _mm256_addsub_ps(_mm256_mul_ps(a, _mm256_set1_ps(real)), _mm256_mul_ps(swapped, _mm256_set1_ps(imag)));
+#elif defined(__ARM_NEON)
+    const float imagFactors[4] = {-imag, imag, -imag, imag};
+    return vmlaq_f32(vmulq_n_f32(a, real), vrev64q_f32(a), vld1q_f32(imagFactors));
+#else
+    HostVector result;
+    for(uint32_t i = 0; i < HOST_LANE_COUNT; ++i) {
+        result.values[i * 2] = a.values[i * 2] * real - a.values[i * 2 + 1] * imag;
+        result.values[i * 2 + 1] = a.values[i * 2] * imag + a.values[i * 2 + 1] * real;
+    }
+    return result;
+#endif
+}
+
+void planVulkanFFTAxisOnHost(VulkanFFTPlan* vulkanFFTPlan, uint32_t axis) {
+    VulkanFFTAxis* vulkanFFTAxis = &vulkanFFTPlan->axes[axis];
+    // Real transforms use a full length complex FFT on the host and radix 8 is split into radix 4 and 2 stages
+    uint32_t sampleCount = vulkanFFTAxis->sampleCount;
+    factorizeVulkanFFTAxis(vulkanFFTAxis, sampleCount, (vulkanFFTPlan->maxRadix && vulkanFFTPlan->maxRadix < 4) ? vulkanFFTPlan->maxRadix : 4);
+    uint32_t fftSampleCount = (vulkanFFTAxis->bluesteinSampleCount) ? vulkanFFTAxis->bluesteinSampleCount : sampleCount;
+    // The table holds exp(2 pi i k / n) of the FFT size, followed by the Bluestein table with the 1/n of the convolution included
+    vulkanFFTAxis->hostTable = (float*)malloc(sizeof(float) * 2 * (fftSampleCount + ((vulkanFFTAxis->bluesteinSampleCount) ? sampleCount + fftSampleCount : 0)));
+    for(uint32_t i = 0; i < fftSampleCount; ++i) {
+        double angle = 2.0 * M_PI * i / fftSampleCount;
+        vulkanFFTAxis->hostTable[i * 2] = (float)cos(angle);
+        vulkanFFTAxis->hostTable[i * 2 + 1] = (float)sin(angle);
+    }
+    if(vulkanFFTAxis->bluesteinSampleCount)
+        fillVulkanFFTBluesteinTable(&vulkanFFTAxis->hostTable[fftSampleCount * 2], sampleCount, fftSampleCount, (vulkanFFTPlan->inverse) ? -1.0 : 1.0, 1.0 / fftSampleCount);
+}
+
+void transformVulkanFFTPassOnHost(const float* input, float* output, const float* table, uint32_t sampleCount, uint32_t radix, uint32_t stageSize, float directionFactor) {
+    // Stockham radix pass over all lanes, every vector holds the same sample of HOST_LANE_COUNT lines
+    uint32_t radixStride = sampleCount / radix, tableStep = sampleCount / (stageSize * radix);
+    HostVector values[8], results[8];
+    for(uint32_t i = 0; i < radixStride; ++i) {
+        uint32_t j = i % stageSize;
+        for(uint32_t k = 0; k < radix; ++k) {
+            values[k] = hostVectorLoad(&input[(i + k * radixStride) * HOST_LANE_COUNT * 2]);
+            if(k > 0 && j > 0) {
+                const float* twiddleFactor = &table[k * j * tableStep * 2];
+                values[k] = hostVectorMultiply(values[k], twiddleFactor[0], directionFactor * twiddleFactor[1]);
+            }
+        }
+        if(radix == 2) {
+            results[0] = hostVectorAdd(values[0], values[1]);
+            results[1] = hostVectorSubtract(values[0], values[1]);
+        } else if(radix == 4) {
+            HostVector a = hostVectorAdd(values[0], values[2]), b = hostVectorSubtract(values[0], values[2]),
+                       c = hostVectorAdd(values[1], values[3]), d = hostVectorMultiply(hostVectorSubtract(values[1], values[3]), 0.0F, directionFactor);
+            results[0] = hostVectorAdd(a, c);
+            results[1] = hostVectorAdd(b, d);
+            results[2] = hostVectorSubtract(a, c);
+            results[3] = hostVectorSubtract(b, d);
+        } else
+            // Odd radices sum up all products with the roots of unity, which are in the table too
+            for(uint32_t q = 0; q < radix; ++q) {
+                results[q] = values[0];
+                for(uint32_t k = 1; k < radix; ++k) {
+                    const float* root = &table[(q * k % radix) * radixStride * 2];
+                    results[q] = hostVectorAdd(results[q], hostVectorMultiply(values[k], root[0], directionFactor * root[1]));
                 }
-                VkWriteDescriptorSet writeDescriptorSet = {0};
-                writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                writeDescriptorSet.dstSet = vulkanFFTAxis->descriptorSets[j];
-                writeDescriptorSet.dstBinding = i;
-                writeDescriptorSet.dstArrayElement = 0;
-                writeDescriptorSet.descriptorType = descriptorType[i];
-                writeDescriptorSet.descriptorCount = 1;
-                writeDescriptorSet.pBufferInfo = &descriptorBufferInfo;
-                vkUpdateDescriptorSets(vulkanFFTPlan->context->device, 1, &writeDescriptorSet, 0, NULL);
             }
+        for(uint32_t q = 0; q < radix; ++q)
+            hostVectorStore(&output[((i - j) * radix + j + q * stageSize) * HOST_LANE_COUNT * 2], results[q]);
+    }
+}
+
+float* transformVulkanFFTLinesOnHost(VulkanFFTAxis* vulkanFFTAxis, float* values, float* swapValues, uint32_t sampleCount, float directionFactor) {
+    // Returns the buffer holding the result
+    uint32_t stageSize = 1;
+    for(uint32_t i = 0; i < vulkanFFTAxis->stageCount; ++i) {
+        transformVulkanFFTPassOnHost(values, swapValues, vulkanFFTAxis->hostTable, sampleCount, vulkanFFTAxis->stageRadix[i], stageSize, directionFactor);
+        stageSize *= vulkanFFTAxis->stageRadix[i];
+        float* aux = values;
+        values = swapValues;
+        swapValues = aux;
+    }
+    return values;
+}
+
+void multiplyVulkanFFTLinesOnHost(float* values, const float* factors, uint32_t sampleCount) {
+    for(uint32_t i = 0; i < sampleCount; ++i) {
+        float* address = &values[i * HOST_LANE_COUNT * 2];
+        hostVectorStore(address, hostVectorMultiply(hostVectorLoad(address), factors[i * 2], factors[i * 2 + 1]));
     }
+}
 
+void transformVulkanFFTAxisOnHost(VulkanFFTPlan* vulkanFFTPlan, uint32_t axis, const float* input, float* output) {
+    VulkanFFTAxis* vulkanFFTAxis = &vulkanFFTPlan->axes[axis];
+    bool realPass = vulkanFFTPlan->realTransform && axis == 0;
+    uint64_t extent[3] = {vulkanFFTPlan->axes[0].sampleCount, vulkanFFTPlan->axes[1].sampleCount, vulkanFFTPlan->axes[2].sampleCount};
+    if(vulkanFFTPlan->realTransform)
+        extent[0] = extent[0] / 2 + 1;
+    uint32_t sampleCount = vulkanFFTAxis->sampleCount;
+    uint32_t fftSampleCount = (vulkanFFTAxis->bluesteinSampleCount) ? vulkanFFTAxis->bluesteinSampleCount : sampleCount;
+    // Line l starts at (l / stride) * stride * extent + l % stride, so neighboring lanes of the y and z axes are neighboring columns
+    uint64_t stride = (axis == 0) ? 1 : (axis == 1) ? extent[0] : extent[0] * extent[1];
+    uint64_t lineCount = extent[0] * extent[1] * extent[2] * vulkanFFTPlan->batchCount / extent[axis];
+    uint32_t outputCount = (realPass && !vulkanFFTPlan->inverse) ? sampleCount / 2 + 1 : sampleCount;
+    float directionFactor = (vulkanFFTPlan->inverse) ? -1.0F : 1.0F;
+    float normalizationFactor = (vulkanFFTPlan->inverse) ? 1.0F : 1.0F / sampleCount;
+    int groupCount = (int)((lineCount + HOST_LANE_COUNT - 1) / HOST_LANE_COUNT);
+    #pragma omp parallel
     {
-        vulkanFFTAxis->pipelines = (VkPipeline*)malloc(sizeof(VkPipeline) * SUPPORTED_RADIX_LEVELS);
-        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {0};
-        pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutCreateInfo.setLayoutCount = vulkanFFTAxis->stageCount;
-        pipelineLayoutCreateInfo.pSetLayouts = vulkanFFTAxis->descriptorSetLayouts;
-        assert(vkCreatePipelineLayout(vulkanFFTPlan->context->device, &pipelineLayoutCreateInfo, vulkanFFTPlan->context->allocator, &vulkanFFTAxis->pipelineLayout) == VK_SUCCESS);
-        VkPipelineShaderStageCreateInfo pipelineShaderStageCreateInfo[SUPPORTED_RADIX_LEVELS] = {0};
-        VkComputePipelineCreateInfo computePipelineCreateInfo[SUPPORTED_RADIX_LEVELS] = {0};
-        for(uint32_t i = 0; i < SUPPORTED_RADIX_LEVELS; ++i) {
-            pipelineShaderStageCreateInfo[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-            pipelineShaderStageCreateInfo[i].stage = VK_SHADER_STAGE_COMPUTE_BIT;
-            pipelineShaderStageCreateInfo[i].module = vulkanFFTPlan->context->shaderModules[i];
-            pipelineShaderStageCreateInfo[i].pName = "main";
-            computePipelineCreateInfo[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-            computePipelineCreateInfo[i].stage = pipelineShaderStageCreateInfo[i];
-            computePipelineCreateInfo[i].layout = vulkanFFTAxis->pipelineLayout;
+        float* work[2] = {
+            (float*)malloc(sizeof(float) * 2 * HOST_LANE_COUNT * fftSampleCount),
+            (float*)malloc(sizeof(float) * 2 * HOST_LANE_COUNT * fftSampleCount)
+        };
+        #pragma omp for schedule(static)
+        for(int group = 0; group < groupCount; ++group) {
+            uint64_t lineStart[HOST_LANE_COUNT];
+            uint32_t laneCount = (uint32_t)((lineCount - (uint64_t)group * HOST_LANE_COUNT < HOST_LANE_COUNT) ? lineCount - (uint64_t)group * HOST_LANE_COUNT : HOST_LANE_COUNT);
+            // Unused lanes and the Bluestein padding stay zero
+            float* values = work[0];
+            memset(values, 0, sizeof(float) * 2 * HOST_LANE_COUNT * fftSampleCount);
+            for(uint32_t lane = 0; lane < laneCount; ++lane) {
+                uint64_t line = (uint64_t)group * HOST_LANE_COUNT + lane;
+                lineStart[lane] = line / stride * stride * extent[axis] + line % stride;
+                for(uint32_t k = 0; k < sampleCount; ++k) {
+                    float* value = &values[(k * HOST_LANE_COUNT + lane) * 2];
+                    if(realPass && !vulkanFFTPlan->inverse) {
+                        // Real samples are packed at the beginning of a row
+                        value[0] = input[lineStart[lane] * 2 + k];
+                    } else if(realPass) {
+                        // Only n/2+1 values are stored, the others are conjugate symmetric
+                        uint32_t mirrored = (k <= sampleCount / 2) ? k : sampleCount - k;
+                        value[0] = input[(lineStart[lane] + mirrored) * 2];
+                        value[1] = (k <= sampleCount / 2) ? input[(lineStart[lane] + mirrored) * 2 + 1] : -input[(lineStart[lane] + mirrored) * 2 + 1];
+                    } else {
+                        value[0] = input[(lineStart[lane] + k * stride) * 2];
+                        value[1] = input[(lineStart[lane] + k * stride) * 2 + 1];
+                    }
+                }
+            }
+            if(vulkanFFTAxis->bluesteinSampleCount) {
+                const float* chirp = &vulkanFFTAxis->hostTable[fftSampleCount * 2];
+                multiplyVulkanFFTLinesOnHost(values, chirp, sampleCount);
+                values = transformVulkanFFTLinesOnHost(vulkanFFTAxis, values, work[values == work[0]], fftSampleCount, 1.0F);
+                multiplyVulkanFFTLinesOnHost(values, &chirp[sampleCount * 2], fftSampleCount);
+                values = transformVulkanFFTLinesOnHost(vulkanFFTAxis, values, work[values == work[0]], fftSampleCount, -1.0F);
+                multiplyVulkanFFTLinesOnHost(values, chirp, sampleCount);
+            } else
+                values = transformVulkanFFTLinesOnHost(vulkanFFTAxis, values, work[1], fftSampleCount, directionFactor);
+            for(uint32_t lane = 0; lane < laneCount; ++lane)
+                for(uint32_t k = 0; k < outputCount; ++k) {
+                    const float* value = &values[(k * HOST_LANE_COUNT + lane) * 2];
+                    if(realPass && vulkanFFTPlan->inverse)
+                        output[lineStart[lane] * 2 + k] = value[0];
+                    else {
+                        output[(lineStart[lane] + k * stride) * 2] = value[0] * normalizationFactor;
+                        output[(lineStart[lane] + k * stride) * 2 + 1] = value[1] * normalizationFactor;
+                    }
+                }
         }
-        assert(vkCreateComputePipelines(vulkanFFTPlan->context->device, VK_NULL_HANDLE, SUPPORTED_RADIX_LEVELS, computePipelineCreateInfo, vulkanFFTPlan->context->allocator, vulkanFFTAxis->pipelines) == VK_SUCCESS);
+        free(work[0]);
+        free(work[1]);
     }
+}
+
+double getVulkanFFTTime() {
+    // In nanoseconds
+    struct timespec time;
+    timespec_get(&time, TIME_UTC);
+    return time.tv_sec * 1.0e9 + time.tv_nsec;
+}
 
-    if(vulkanFFTAxis->stageCount & 1)
-        vulkanFFTPlan->resultInSwapBuffer = !vulkanFFTPlan->resultInSwapBuffer;
+double vulkanFFTFlopCount(VulkanFFTPlan* vulkanFFTPlan) {
+    // 5 n log2(n) flops per transform, n being the product of all axes
+    double sampleCount = (double)vulkanFFTPlan->axes[0].sampleCount * vulkanFFTPlan->axes[1].sampleCount * vulkanFFTPlan->axes[2].sampleCount;
+    return 5.0 * sampleCount * log2(sampleCount) * ((vulkanFFTPlan->batchCount) ? vulkanFFTPlan->batchCount : 1);
 }
 
-void createVulkanFFT(VulkanFFTPlan* vulkanFFTPlan) {
+void calibrateVulkanFFTHost(VulkanFFTContext* context) {
+    // The fastest of several repetitions of an empty submission and of a small 2D transform on the host, the first repetition warms up the driver and the threads
+    VkCommandBuffer commandBuffer = createCommandBuffer(context, 0);
+    vkEndCommandBuffer(commandBuffer);
+    VkSubmitInfo submitInfo = {0};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    VulkanFFTPlan vulkanFFTPlan = {0};
+    vulkanFFTPlan.context = context;
+    vulkanFFTPlan.onHost = true;
+    for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan.axes); ++i)
+        vulkanFFTPlan.axes[i].sampleCount = calibrationExtent[i];
+    createVulkanFFT(&vulkanFFTPlan);
+    float* values = (float*)calloc(vulkanFFTPlan.bufferSize, 1);
+    double hostTime = INFINITY;
+    context->submitTime = INFINITY;
+    for(uint32_t i = 0; i <= calibrationRepetitions; ++i) {
+        double timeA = getVulkanFFTTime();
+        assert(vkQueueSubmit(context->queue, 1, &submitInfo, context->fence) == VK_SUCCESS);
+        assert(vkWaitForFences(context->device, 1, &context->fence, VK_TRUE, 100000000000) == VK_SUCCESS);
+        double timeB = getVulkanFFTTime();
+        assert(vkResetFences(context->device, 1, &context->fence) == VK_SUCCESS);
+        double timeC = getVulkanFFTTime();
+        transformVulkanFFTOnHost(&vulkanFFTPlan, values, values);
+        double timeD = getVulkanFFTTime();
+        if(i == 0)
+            continue;
+        context->submitTime = fmin(context->submitTime, timeB - timeA);
+        hostTime = fmin(hostTime, timeD - timeC);
+    }
+    context->hostGigaFlopsPerSecond = vulkanFFTFlopCount(&vulkanFFTPlan) / fmax(hostTime, 1.0);
+    free(values);
+    destroyVulkanFFT(&vulkanFFTPlan);
+    vkFreeCommandBuffers(context->device, context->commandPool, 1, &commandBuffer);
+}
+
+bool preferVulkanFFTOnHost(VulkanFFTPlan* vulkanFFTPlan) {
+    // Small transforms take less time on the host than a submission to the device and waiting for it,
+    // the work of the device itself is left out, as it is small against the submit time in that range
+    VulkanFFTContext* context = vulkanFFTPlan->context;
+    if(context->hostGigaFlopsPerSecond == 0.0)
+        calibrateVulkanFFTHost(context);
+    return context->hostGigaFlopsPerSecond > 0.0 && vulkanFFTFlopCount(vulkanFFTPlan) / context->hostGigaFlopsPerSecond < context->submitTime;
+}
+
+void transformVulkanFFTOnHost(VulkanFFTPlan* vulkanFFTPlan, const void* input, void* output) {
+    // Input and output have the layout of the buffers of the plan and may be the same
+    assert(vulkanFFTPlan->onHost);
+    const float* source = (const float*)input;
+    for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->axes); ++i) {
+        uint32_t axis = vulkanFFTAxisOrder(vulkanFFTPlan, i);
+        if(!vulkanFFTAxisIsTransformed(vulkanFFTPlan, axis))
+            continue;
+        transformVulkanFFTAxisOnHost(vulkanFFTPlan, axis, source, (float*)output);
+        source = (const float*)output;
+    }
+    if(source != output)
+        memcpy(output, input, vulkanFFTPlan->bufferSize);
+}
+
+bool createVulkanFFT(VulkanFFTPlan* vulkanFFTPlan) {
     vulkanFFTPlan->resultInSwapBuffer = false;
-    vulkanFFTPlan->bufferSize = sizeof(float) * 2 * vulkanFFTPlan->axes[0].sampleCount * vulkanFFTPlan->axes[1].sampleCount * vulkanFFTPlan->axes[2].sampleCount;
-    for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->buffer); ++i)
-        createBuffer(vulkanFFTPlan->context, &vulkanFFTPlan->buffer[i], &vulkanFFTPlan->deviceMemory[i], VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT, vulkanFFTPlan->bufferSize);
+    vulkanFFTPlan->queryPool = VK_NULL_HANDLE;
+    vulkanFFTPlan->scratchSize = 0;
+    if(vulkanFFTPlan->batchCount == 0)
+        vulkanFFTPlan->batchCount = 1;
+    uint32_t rowLength = vulkanFFTPlan->axes[0].sampleCount;
+    if(vulkanFFTPlan->realTransform) {
+        assert(rowLength % 2 == 0);
+        rowLength = rowLength / 2 + 1;
+    }
+    vulkanFFTPlan->bufferSize = ((vulkanFFTPlan->halfPrecision) ? sizeof(uint16_t) : sizeof(float)) * 2 * rowLength * vulkanFFTPlan->axes[1].sampleCount * vulkanFFTPlan->axes[2].sampleCount * vulkanFFTPlan->batchCount;
+    // Half precision values are accessed in pairs
+    vulkanFFTPlan->bufferSize = (vulkanFFTPlan->bufferSize + 7) / 8 * 8;
+    if(vulkanFFTPlan->onHost) {
+        // Host plans only need the radix schedule and tables of every axis, the context is not used
+        assert(!vulkanFFTPlan->halfPrecision && !vulkanFFTPlan->profile && !vulkanFFTPlan->input.buffer && !vulkanFFTPlan->output.buffer);
+        for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->axes); ++i) {
+            vulkanFFTPlan->axes[i].passCount = 0;
+            vulkanFFTPlan->axes[i].stageRadix = NULL;
+            vulkanFFTPlan->axes[i].hostTable = NULL;
+            if(vulkanFFTAxisIsTransformed(vulkanFFTPlan, i))
+                planVulkanFFTAxisOnHost(vulkanFFTPlan, i);
+        }
+        return true;
+    }
+    if(vulkanFFTPlan->inPlace)
+        for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->axes); ++i)
+            if(vulkanFFTAxisIsTransformed(vulkanFFTPlan, i) && !vulkanFFTAxisFitsInPlace(vulkanFFTPlan, i))
+                return false;
+    // All axes are planned first, as the number of passes decides which buffers the plan needs
+    uint32_t swapCount = 0;
+    for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->axes); ++i) {
+        uint32_t axis = vulkanFFTAxisOrder(vulkanFFTPlan, i);
+        vulkanFFTPlan->axes[axis].passCount = 0;
+        if(!vulkanFFTAxisIsTransformed(vulkanFFTPlan, axis))
+            continue;
+        planVulkanFFTAxis(vulkanFFTPlan, axis);
+        swapCount += vulkanFFTAxisSwapCount(vulkanFFTPlan, axis);
+    }
+    createVulkanFFTBuffers(vulkanFFTPlan, swapCount);
+    for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->axes); ++i) {
+        uint32_t axis = vulkanFFTAxisOrder(vulkanFFTPlan, i);
+        if(vulkanFFTAxisIsTransformed(vulkanFFTPlan, axis))
+            createVulkanFFTAxis(vulkanFFTPlan, axis);
+    }
+    if(vulkanFFTPlan->profile) {
+        // One timestamp at the beginning and one after every pass
+        assert(vulkanFFTPlan->context->physicalDeviceProperties.limits.timestampComputeAndGraphics);
+        vulkanFFTPlan->queryCount = 1;
+        for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->axes); ++i) {
+            VulkanFFTAxis* vulkanFFTAxis = &vulkanFFTPlan->axes[vulkanFFTAxisOrder(vulkanFFTPlan, i)];
+            vulkanFFTAxis->firstQuery = vulkanFFTPlan->queryCount - 1;
+            vulkanFFTPlan->queryCount += vulkanFFTAxis->passCount;
+        }
+        VkQueryPoolCreateInfo queryPoolCreateInfo = {0};
+        queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolCreateInfo.queryCount = vulkanFFTPlan->queryCount;
+        assert(vkCreateQueryPool(vulkanFFTPlan->context->device, &queryPoolCreateInfo, vulkanFFTPlan->context->allocator, &vulkanFFTPlan->queryPool) == VK_SUCCESS);
+    }
+    return true;
+}
+
+void recordVulkanFFTPasses(VulkanFFTPlan* vulkanFFTPlan, VkCommandBuffer commandBuffer) {
+    if(vulkanFFTPlan->queryPool) {
+        vkCmdResetQueryPool(commandBuffer, vulkanFFTPlan->queryPool, 0, vulkanFFTPlan->queryCount);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, vulkanFFTPlan->queryPool, 0);
+    }
     for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->axes); ++i)
-        if(vulkanFFTPlan->axes[i].sampleCount > 1)
-            planVulkanFFTAxis(vulkanFFTPlan, i);
+        recordVulkanFFTAxis(vulkanFFTPlan, vulkanFFTAxisOrder(vulkanFFTPlan, i), commandBuffer);
 }
 
 void recordVulkanFFT(VulkanFFTPlan* vulkanFFTPlan, VkCommandBuffer commandBuffer) {
-    VkBufferMemoryBarrier bufferMemoryBarriers[2] = {0};
-    for(uint32_t i = 0; i < COUNT_OF(bufferMemoryBarriers); ++i) {
-        bufferMemoryBarriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-        bufferMemoryBarriers[i].srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
-        bufferMemoryBarriers[i].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-        bufferMemoryBarriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        bufferMemoryBarriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        bufferMemoryBarriers[i].buffer = vulkanFFTPlan->buffer[1-i];
-        bufferMemoryBarriers[i].offset = 0;
-        bufferMemoryBarriers[i].size = VK_WHOLE_SIZE;
-    }
-    const uint32_t remap[3][3] = {{0, 1, 2}, {1, 2, 0}, {2, 0, 1}};
-    for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->axes); ++i) {
-        if(vulkanFFTPlan->axes[i].sampleCount <= 1)
-            continue;
+    // The result is visible to all commands recorded afterwards
+    recordVulkanFFTPasses(vulkanFFTPlan, commandBuffer);
+    VkMemoryBarrier memoryBarrier = {0};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+}
+
+VkCommandBuffer recordVulkanFFTSlot(VulkanFFTPlan* vulkanFFTPlan, VkBuffer uploadBuffer, VulkanFFTPlan* previousPlan, VkBuffer downloadBuffer, bool transform) {
+    // The upload comes first and the passes only wait for passes, so the upload of this slot overlaps with the transform of the previous slot.
+    // The download of the previous result orders all later transfers and passes after it, which reuse the buffers of the previous slot.
+    // The buffers of this slot were last used by its previous submission, which the caller waited for.
+    VkCommandBuffer commandBuffer = createCommandBuffer(vulkanFFTPlan->context, 0);
+    VkBufferCopy copyRegion = {0};
+    copyRegion.size = vulkanFFTPlan->bufferSize;
+    if(transform)
+        vkCmdCopyBuffer(commandBuffer, uploadBuffer, vulkanFFTPlan->buffer[0], 1, &copyRegion);
+    VkMemoryBarrier memoryBarrier = {0};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+    copyRegion.size = previousPlan->bufferSize;
+    vkCmdCopyBuffer(commandBuffer, previousPlan->buffer[previousPlan->resultInSwapBuffer], downloadBuffer, 1, &copyRegion);
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+    if(transform)
+        recordVulkanFFTPasses(vulkanFFTPlan, commandBuffer);
+    vkEndCommandBuffer(commandBuffer);
+    return commandBuffer;
+}
+
+bool queryVulkanFFTProfile(VulkanFFTPlan* vulkanFFTPlan) {
+    // Does not wait, returns false if the last recorded transform did not finish yet or the plan is not profiled
+    if(!vulkanFFTPlan->profile || !vulkanFFTPlan->queryPool)
+        return false;
+    uint64_t* timestamps = (uint64_t*)malloc(sizeof(uint64_t) * vulkanFFTPlan->queryCount);
+    bool available = vkGetQueryPoolResults(vulkanFFTPlan->context->device, vulkanFFTPlan->queryPool, 0, vulkanFFTPlan->queryCount, sizeof(uint64_t) * vulkanFFTPlan->queryCount, timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+    double timestampPeriod = vulkanFFTPlan->context->physicalDeviceProperties.limits.timestampPeriod;
+    for(uint32_t i = 0; available && i < COUNT_OF(vulkanFFTPlan->axes); ++i) {
         VulkanFFTAxis* vulkanFFTAxis = &vulkanFFTPlan->axes[i];
-        for(uint32_t j = 0; j < vulkanFFTAxis->stageCount; ++j) {
-            uint32_t workGroupCount = vulkanFFTAxis->sampleCount / (vulkanFFTAxis->stageRadix[j] * workGroupSize);
-            if(workGroupCount == 0)
-                workGroupCount = 1;
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vulkanFFTAxis->pipelines[30-__builtin_clz(vulkanFFTAxis->stageRadix[j])]);
-            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vulkanFFTAxis->pipelineLayout, 0, 1, &vulkanFFTAxis->descriptorSets[j], 0, NULL);
-            vkCmdDispatch(commandBuffer, workGroupCount, vulkanFFTPlan->axes[remap[i][1]].sampleCount, vulkanFFTPlan->axes[remap[i][2]].sampleCount);
-            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_DEPENDENCY_BY_REGION_BIT, 0, NULL, COUNT_OF(bufferMemoryBarriers), bufferMemoryBarriers, 0, NULL);
+        VulkanFFTProfile* axisProfile = &vulkanFFTAxis->profile;
+        memset(axisProfile, 0, sizeof(VulkanFFTProfile));
+        for(uint32_t j = 0; j < vulkanFFTAxis->passCount; ++j) {
+            VulkanFFTProfile* profile = &vulkanFFTAxis->passes[j].profile;
+            profile->time = (double)(timestamps[vulkanFFTAxis->firstQuery + 1 + j] - timestamps[vulkanFFTAxis->firstQuery + j]) * timestampPeriod;
+            // Flops and bytes per nanosecond are GFLOP/s and GB/s
+            profile->gigaFlopsPerSecond = (profile->time > 0.0) ? profile->flopCount / profile->time : 0.0;
+            profile->gigaBytesPerSecond = (profile->time > 0.0) ? profile->byteCount / profile->time : 0.0;
+            axisProfile->time += profile->time;
+            axisProfile->flopCount += profile->flopCount;
+            axisProfile->byteCount += profile->byteCount;
         }
+        axisProfile->gigaFlopsPerSecond = (axisProfile->time > 0.0) ? axisProfile->flopCount / axisProfile->time : 0.0;
+        axisProfile->gigaBytesPerSecond = (axisProfile->time > 0.0) ? axisProfile->byteCount / axisProfile->time : 0.0;
     }
+    free(timestamps);
+    return available;
 }
 
 void destroyVulkanFFT(VulkanFFTPlan* vulkanFFTPlan) {
+    if(vulkanFFTPlan->onHost) {
+        for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->axes); ++i) {
+            free(vulkanFFTPlan->axes[i].stageRadix);
+            free(vulkanFFTPlan->axes[i].hostTable);
+        }
+        return;
+    }
+    if(vulkanFFTPlan->queryPool)
+        vkDestroyQueryPool(vulkanFFTPlan->context->device, vulkanFFTPlan->queryPool, vulkanFFTPlan->context->allocator);
     for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->axes); ++i) {
-        if(vulkanFFTPlan->axes[i].sampleCount <= 1)
+        if(vulkanFFTPlan->axes[i].passCount == 0)
             continue;
-        VulkanFFTAxis* vulkanFFTAxis = &vulkanFFTPlan->axes[i];
-        vkDestroyBuffer(vulkanFFTPlan->context->device, vulkanFFTAxis->ubo, vulkanFFTPlan->context->allocator);
-        vkFreeMemory(vulkanFFTPlan->context->device, vulkanFFTAxis->uboDeviceMemory, vulkanFFTPlan->context->allocator);
-        vkDestroyDescriptorPool(vulkanFFTPlan->context->device, vulkanFFTAxis->descriptorPool, vulkanFFTPlan->context->allocator);
-        vkDestroyDescriptorSetLayout(vulkanFFTPlan->context->device, vulkanFFTAxis->descriptorSetLayouts[0], vulkanFFTPlan->context->allocator);
-        vkDestroyPipelineLayout(vulkanFFTPlan->context->device, vulkanFFTAxis->pipelineLayout, vulkanFFTPlan->context->allocator);
-        for(uint32_t j = 0; j < SUPPORTED_RADIX_LEVELS; ++j)
-            vkDestroyPipeline(vulkanFFTPlan->context->device, vulkanFFTAxis->pipelines[j], vulkanFFTPlan->context->allocator);
-        free(vulkanFFTAxis->pipelines);
-        free(vulkanFFTAxis->stageRadix);
-        free(vulkanFFTAxis->descriptorSetLayouts);
-        free(vulkanFFTAxis->descriptorSets);
-    }
-    for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->buffer); ++i) {
-        vkDestroyBuffer(vulkanFFTPlan->context->device, vulkanFFTPlan->buffer[i], vulkanFFTPlan->context->allocator);
-        vkFreeMemory(vulkanFFTPlan->context->device, vulkanFFTPlan->deviceMemory[i], vulkanFFTPlan->context->allocator);
+        destroyVulkanFFTAxis(vulkanFFTPlan, i);
+        free(vulkanFFTPlan->axes[i].stageRadix);
+    }
+    forgetVulkanFFTTransferBuffer(vulkanFFTPlan->context, vulkanFFTPlan->input.buffer);
+    forgetVulkanFFTTransferBuffer(vulkanFFTPlan->context, vulkanFFTPlan->output.buffer);
+    destroyVulkanFFTBuffers(vulkanFFTPlan);
+}
+
+
+
+bool createVulkanFFTConvolution(VulkanFFTConvolution* vulkanFFTConvolution) {
+    // The forward plan is configured by the caller, the inverse plan is a copy of it
+    VulkanFFTPlan* forward = &vulkanFFTConvolution->forward;
+    VulkanFFTContext* context = forward->context;
+    forward->inverse = false;
+    vulkanFFTConvolution->inverse = *forward;
+    vulkanFFTConvolution->inverse.inverse = true;
+    // The spectra stay in the buffers of the plans, only the input and output of the whole convolution can be buffers of the user
+    memset(&forward->output, 0, sizeof(VulkanFFTBufferLayout));
+    memset(&vulkanFFTConvolution->inverse.input, 0, sizeof(VulkanFFTBufferLayout));
+    // Both plans have the same shape, so they either both fit in place or neither does
+    if(!createVulkanFFT(forward))
+        return false;
+    createVulkanFFT(&vulkanFFTConvolution->inverse);
+    vulkanFFTConvolution->kernelCount = 0;
+    vulkanFFTConvolution->kernels = NULL;
+
+    uint32_t extent[3] = {forward->axes[0].sampleCount, forward->axes[1].sampleCount, forward->axes[2].sampleCount};
+    if(forward->realTransform)
+        extent[0] = extent[0] / 2 + 1;
+    VulkanFFTPass* pass = &vulkanFFTConvolution->pass;
+    memset(pass, 0, sizeof(VulkanFFTPass));
+    pass->workGroupCount[0] = (extent[0] + defaultWorkGroupSize - 1) / defaultWorkGroupSize;
+    pass->workGroupCount[1] = extent[1];
+    pass->workGroupCount[2] = extent[2] * forward->batchCount;
+    assert(pass->workGroupCount[2] <= context->physicalDeviceProperties.limits.maxComputeWorkGroupCount[2]);
+    VulkanFFTPushConstants* pushConstants = &pass->pushConstants;
+    uint32_t stride[4] = {1, extent[0], extent[0] * extent[1], extent[0] * extent[1] * extent[2]};
+    for(uint32_t i = 0; i < COUNT_OF(pushConstants->stride); ++i) {
+        pushConstants->stride[i] = stride[i];
+        pushConstants->outputStride[i] = stride[i];
+    }
+    pushConstants->radixStride = extent[0];
+    pushConstants->rowCount = extent[2];
+    pushConstants->directionFactor = (vulkanFFTConvolution->correlation) ? -1.0F : 1.0F;
+    // Both spectra are normalized by the forward transform, but the inverse transform only compensates one of them
+    pushConstants->normalizationFactor = (float)forward->axes[0].sampleCount * forward->axes[1].sampleCount * forward->axes[2].sampleCount;
+    pushConstants->halfPrecision = (forward->halfPrecision) ? 7 : 0;
+
+    {
+        VkDescriptorPoolSize descriptorPoolSize = {0};
+        descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorPoolSize.descriptorCount = 2;
+        VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {0};
+        descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        descriptorPoolCreateInfo.poolSizeCount = 1;
+        descriptorPoolCreateInfo.pPoolSizes = &descriptorPoolSize;
+        descriptorPoolCreateInfo.maxSets = 1;
+        assert(vkCreateDescriptorPool(context->device, &descriptorPoolCreateInfo, context->allocator, &vulkanFFTConvolution->descriptorPool) == VK_SUCCESS);
+        // The product of the spectra is written into the input of the inverse plan, so the input spectrum stays intact
+        VkBuffer buffers[2] = {forward->buffer[forward->resultInSwapBuffer], vulkanFFTConvolution->inverse.buffer[0]};
+        pass->descriptorSets[0] = createVulkanFFTDescriptorSet(context, vulkanFFTConvolution->descriptorPool, 0, buffers);
+    }
+
+    uint32_t specializationData[VULKAN_FFT_SPECIALIZATION_CONSTANT_COUNT] = {defaultWorkGroupSize, 0, 0, 0, 0, false, 1, 0};
+    vulkanFFTConvolution->pipeline = acquireVulkanFFTPipeline(context, context->pointwiseShaderModule, specializationData);
+    return true;
+}
+
+uint32_t addVulkanFFTConvolutionKernel(VulkanFFTConvolution* vulkanFFTConvolution, VkCommandBuffer commandBuffer) {
+    // Transforms the kernel which was uploaded to the input buffer of the forward plan and keeps its spectrum on the device
+    VulkanFFTPlan* forward = &vulkanFFTConvolution->forward;
+    VulkanFFTContext* context = forward->context;
+    vulkanFFTConvolution->kernels = (VulkanFFTConvolutionKernel*)realloc(vulkanFFTConvolution->kernels, sizeof(VulkanFFTConvolutionKernel) * (vulkanFFTConvolution->kernelCount + 1));
+    VulkanFFTConvolutionKernel* kernel = &vulkanFFTConvolution->kernels[vulkanFFTConvolution->kernelCount];
+    allocateVulkanFFTBuffer(context, &kernel->buffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, forward->bufferSize, NULL);
+    VkDescriptorPoolSize descriptorPoolSize = {0};
+    descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorPoolSize.descriptorCount = 1;
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {0};
+    descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCreateInfo.poolSizeCount = 1;
+    descriptorPoolCreateInfo.pPoolSizes = &descriptorPoolSize;
+    descriptorPoolCreateInfo.maxSets = 1;
+    assert(vkCreateDescriptorPool(context->device, &descriptorPoolCreateInfo, context->allocator, &kernel->descriptorPool) == VK_SUCCESS);
+    kernel->descriptorSet = createVulkanFFTDescriptorSet(context, kernel->descriptorPool, 1, &kernel->buffer);
+
+    recordVulkanFFT(forward, commandBuffer);
+    VkBufferCopy copyRegion = {0};
+    copyRegion.size = forward->bufferSize;
+    vkCmdCopyBuffer(commandBuffer, forward->buffer[forward->resultInSwapBuffer], kernel->buffer, 1, &copyRegion);
+    VkMemoryBarrier memoryBarrier = {0};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+    return vulkanFFTConvolution->kernelCount++;
+}
+
+void recordVulkanFFTConvolution(VulkanFFTConvolution* vulkanFFTConvolution, uint32_t kernelIndex, bool transformInput, VkCommandBuffer commandBuffer) {
+    // Without transformInput the spectrum of the previous input is reused, e.g. to apply several kernels to one input
+    assert(kernelIndex < vulkanFFTConvolution->kernelCount);
+    VulkanFFTPass* pass = &vulkanFFTConvolution->pass;
+    if(transformInput)
+        recordVulkanFFT(&vulkanFFTConvolution->forward, commandBuffer);
+    pass->descriptorSets[1] = vulkanFFTConvolution->kernels[kernelIndex].descriptorSet;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vulkanFFTConvolution->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vulkanFFTConvolution->forward.context->pipelineLayout, 0, COUNT_OF(pass->descriptorSets), pass->descriptorSets, 0, NULL);
+    vkCmdPushConstants(commandBuffer, vulkanFFTConvolution->forward.context->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(VulkanFFTPushConstants), &pass->pushConstants);
+    vkCmdDispatch(commandBuffer, pass->workGroupCount[0], pass->workGroupCount[1], pass->workGroupCount[2]);
+    VkMemoryBarrier memoryBarrier = {0};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_DEPENDENCY_BY_REGION_BIT, 1, &memoryBarrier, 0, NULL, 0, NULL);
+    recordVulkanFFT(&vulkanFFTConvolution->inverse, commandBuffer);
+}
+
+void destroyVulkanFFTConvolution(VulkanFFTConvolution* vulkanFFTConvolution) {
+    VulkanFFTContext* context = vulkanFFTConvolution->forward.context;
+    for(uint32_t i = 0; i < vulkanFFTConvolution->kernelCount; ++i) {
+        VulkanFFTConvolutionKernel* kernel = &vulkanFFTConvolution->kernels[i];
+        vkDestroyDescriptorPool(context->device, kernel->descriptorPool, context->allocator);
+        freeVulkanFFTBuffer(context, kernel->buffer);
+    }
+    free(vulkanFFTConvolution->kernels);
+    vkDestroyDescriptorPool(context->device, vulkanFFTConvolution->descriptorPool, context->allocator);
+    releaseVulkanFFTPipeline(context, vulkanFFTConvolution->pipeline);
+    destroyVulkanFFT(&vulkanFFTConvolution->inverse);
+    destroyVulkanFFT(&vulkanFFTConvolution->forward);
+}
+
+
+
+void createVulkanFFTVisualization(VulkanFFTVisualization* vulkanFFTVisualization) {
+    // Reads the result in the buffers of the plan, which has to be created already
+    VulkanFFTPlan* vulkanFFTPlan = vulkanFFTVisualization->plan;
+    VulkanFFTContext* context = vulkanFFTPlan->context;
+    assert(!vulkanFFTPlan->onHost && !vulkanFFTPlan->output.buffer);
+    if(vulkanFFTVisualization->bitDepth == 0)
+        vulkanFFTVisualization->bitDepth = 8;
+    assert(vulkanFFTVisualization->bitDepth == 8 || vulkanFFTVisualization->bitDepth == 16 || vulkanFFTVisualization->bitDepth == 32);
+    bool realValues = vulkanFFTPlan->realTransform && vulkanFFTPlan->inverse,
+         halfSpectrum = vulkanFFTPlan->realTransform && !vulkanFFTPlan->inverse;
+    uint32_t rowStride = (vulkanFFTPlan->realTransform) ? vulkanFFTPlan->axes[0].sampleCount / 2 + 1 : vulkanFFTPlan->axes[0].sampleCount;
+    vulkanFFTVisualization->width = (halfSpectrum) ? rowStride : vulkanFFTPlan->axes[0].sampleCount;
+    vulkanFFTVisualization->height = vulkanFFTPlan->axes[1].sampleCount * vulkanFFTPlan->axes[2].sampleCount * vulkanFFTPlan->batchCount;
+    uint32_t pixelCount = vulkanFFTVisualization->width * vulkanFFTVisualization->height;
+    // Only the image is downloaded, rounded up to whole words
+    vulkanFFTVisualization->imageSize = ((VkDeviceSize)pixelCount * vulkanFFTVisualization->bitDepth / 8 + 3) / 4 * 4;
+    allocateVulkanFFTBuffer(context, &vulkanFFTVisualization->image, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, vulkanFFTVisualization->imageSize, NULL);
+    allocateVulkanFFTBuffer(context, &vulkanFFTVisualization->range, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(uint32_t) * 2, NULL);
+
+    // Both steps loop over the pixels, so the dispatch is limited to a fixed number of work groups
+    VulkanFFTPass* pass = &vulkanFFTVisualization->pass;
+    memset(pass, 0, sizeof(VulkanFFTPass));
+    pass->workGroupCount[0] = (pixelCount + visualizeWorkGroupSize - 1) / visualizeWorkGroupSize;
+    if(pass->workGroupCount[0] > 4096)
+        pass->workGroupCount[0] = 4096;
+    pass->workGroupCount[1] = 1;
+    pass->workGroupCount[2] = 1;
+    VulkanFFTPushConstants* pushConstants = &pass->pushConstants;
+    uint32_t stride[4] = {vulkanFFTVisualization->width, rowStride, vulkanFFTPlan->axes[1].sampleCount, vulkanFFTPlan->axes[2].sampleCount},
+             outputStride[4] = {vulkanFFTVisualization->shift && !halfSpectrum, vulkanFFTVisualization->shift, vulkanFFTVisualization->shift, realValues};
+    memcpy(pushConstants->stride, stride, sizeof(stride));
+    memcpy(pushConstants->outputStride, outputStride, sizeof(outputStride));
+    pushConstants->radixStride = pixelCount;
+    pushConstants->stageSize = vulkanFFTVisualization->bitDepth;
+    pushConstants->halfPrecision = (vulkanFFTPlan->halfPrecision) ? 1 : 0;
+
+    {
+        VkDescriptorPoolSize descriptorPoolSize = {0};
+        descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorPoolSize.descriptorCount = 3;
+        VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {0};
+        descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        descriptorPoolCreateInfo.poolSizeCount = 1;
+        descriptorPoolCreateInfo.pPoolSizes = &descriptorPoolSize;
+        descriptorPoolCreateInfo.maxSets = 2;
+        assert(vkCreateDescriptorPool(context->device, &descriptorPoolCreateInfo, context->allocator, &vulkanFFTVisualization->descriptorPool) == VK_SUCCESS);
+        VkBuffer buffers[2] = {vulkanFFTPlan->buffer[vulkanFFTPlan->resultInSwapBuffer], vulkanFFTVisualization->image};
+        pass->descriptorSets[0] = createVulkanFFTDescriptorSet(context, vulkanFFTVisualization->descriptorPool, 0, buffers);
+        pass->descriptorSets[1] = createVulkanFFTDescriptorSet(context, vulkanFFTVisualization->descriptorPool, 1, &vulkanFFTVisualization->range);
+    }
+
+    for(uint32_t step = 0; step < COUNT_OF(vulkanFFTVisualization->pipelines); ++step) {
+        uint32_t specializationData[VULKAN_FFT_SPECIALIZATION_CONSTANT_COUNT] = {visualizeWorkGroupSize, 0, 0, vulkanFFTVisualization->mode, step, false, 1, 0};
+        vulkanFFTVisualization->pipelines[step] = acquireVulkanFFTPipeline(context, context->visualizeShaderModule, specializationData);
+    }
+}
+
+void recordVulkanFFTVisualization(VulkanFFTVisualization* vulkanFFTVisualization, VkCommandBuffer commandBuffer) {
+    // The range is reset every time, the reduction only narrows it down
+    VulkanFFTContext* context = vulkanFFTVisualization->plan->context;
+    VulkanFFTPass* pass = &vulkanFFTVisualization->pass;
+    vkCmdFillBuffer(commandBuffer, vulkanFFTVisualization->range, 0, sizeof(uint32_t), 0xFFFFFFFF);
+    vkCmdFillBuffer(commandBuffer, vulkanFFTVisualization->range, sizeof(uint32_t), sizeof(uint32_t), 0);
+    VkMemoryBarrier memoryBarrier = {0};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->pipelineLayout, 0, COUNT_OF(pass->descriptorSets), pass->descriptorSets, 0, NULL);
+    vkCmdPushConstants(commandBuffer, context->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(VulkanFFTPushConstants), &pass->pushConstants);
+    for(uint32_t step = 0; step < COUNT_OF(vulkanFFTVisualization->pipelines); ++step) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vulkanFFTVisualization->pipelines[step]);
+        vkCmdDispatch(commandBuffer, pass->workGroupCount[0], pass->workGroupCount[1], pass->workGroupCount[2]);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+    }
+}
+
+void destroyVulkanFFTVisualization(VulkanFFTVisualization* vulkanFFTVisualization) {
+    VulkanFFTContext* context = vulkanFFTVisualization->plan->context;
+    vkDestroyDescriptorPool(context->device, vulkanFFTVisualization->descriptorPool, context->allocator);
+    for(uint32_t step = 0; step < COUNT_OF(vulkanFFTVisualization->pipelines); ++step)
+        releaseVulkanFFTPipeline(context, vulkanFFTVisualization->pipelines[step]);
+    freeVulkanFFTBuffer(context, vulkanFFTVisualization->image);
+    freeVulkanFFTBuffer(context, vulkanFFTVisualization->range);
+}
+
+
+
+void createVulkanFFTOutOfCore(VulkanFFTOutOfCore* vulkanFFTOutOfCore) {
+    // The plan describes the whole transform on the host, it is never created itself but split into chunk plans
+    VulkanFFTPlan* plan = &vulkanFFTOutOfCore->plan;
+    VulkanFFTContext* context = plan->context;
+    assert(!plan->realTransform && !plan->halfPrecision);
+    if(plan->batchCount == 0)
+        plan->batchCount = 1;
+    // A slot downloads the result of the previous slot after uploading its own chunk, so a single slot would overwrite it
+    if(vulkanFFTOutOfCore->slotCount < 2)
+        vulkanFFTOutOfCore->slotCount = 2;
+    // The chunk plan of every slot needs two device buffers of the chunk size (the Bluestein work buffers of an axis come on top)
+    vulkanFFTOutOfCore->chunkSize = context->physicalDeviceProperties.limits.maxStorageBufferRange;
+    if(vulkanFFTOutOfCore->workingSetSize > 0 && vulkanFFTOutOfCore->workingSetSize / (2 * vulkanFFTOutOfCore->slotCount) < vulkanFFTOutOfCore->chunkSize)
+        vulkanFFTOutOfCore->chunkSize = vulkanFFTOutOfCore->workingSetSize / (2 * vulkanFFTOutOfCore->slotCount);
+    vulkanFFTOutOfCore->chunkSize = vulkanFFTOutOfCore->chunkSize / (sizeof(float) * 2) * (sizeof(float) * 2);
+    assert(vulkanFFTOutOfCore->chunkSize > 0);
+    vulkanFFTOutOfCore->slots = (VulkanFFTOutOfCoreSlot*)malloc(sizeof(VulkanFFTOutOfCoreSlot) * vulkanFFTOutOfCore->slotCount);
+    VkFenceCreateInfo fenceCreateInfo = {0};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    for(uint32_t i = 0; i < vulkanFFTOutOfCore->slotCount; ++i) {
+        VulkanFFTOutOfCoreSlot* slot = &vulkanFFTOutOfCore->slots[i];
+        createBuffer(context, &slot->uploadBuffer, &slot->uploadDeviceMemory, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vulkanFFTOutOfCore->chunkSize);
+        createBuffer(context, &slot->downloadBuffer, &slot->downloadDeviceMemory, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vulkanFFTOutOfCore->chunkSize);
+        assert(vkMapMemory(context->device, slot->uploadDeviceMemory, 0, vulkanFFTOutOfCore->chunkSize, 0, &slot->uploadData) == VK_SUCCESS);
+        assert(vkMapMemory(context->device, slot->downloadDeviceMemory, 0, vulkanFFTOutOfCore->chunkSize, 0, &slot->downloadData) == VK_SUCCESS);
+        assert(vkCreateFence(context->device, &fenceCreateInfo, context->allocator, &slot->fence) == VK_SUCCESS);
+        slot->commandBuffer = slot->downloadCommandBuffer = VK_NULL_HANDLE;
+        slot->pending = false;
+    }
+}
+
+void vulkanFFTOutOfCoreChunkRange(VulkanFFTOutOfCoreStep* step, uint64_t chunk, uint64_t begin[2], uint64_t end[2]) {
+    uint64_t innerChunkCount = (step->innerCount + step->innerChunkSize - 1) / step->innerChunkSize;
+    begin[0] = chunk / innerChunkCount * step->outerChunkSize;
+    begin[1] = chunk % innerChunkCount * step->innerChunkSize;
+    end[0] = (begin[0] + step->outerChunkSize < step->outerCount) ? begin[0] + step->outerChunkSize : step->outerCount;
+    end[1] = (begin[1] + step->innerChunkSize < step->innerCount) ? begin[1] + step->innerChunkSize : step->innerCount;
+}
+
+// The host data of a step is viewed as [outerCount][length][innerCount] complex values and transformed along length.
+// A chunk is staged as [outerChunkSize][length][innerChunkSize], the remainder of partial chunks is left as is,
+// because the rows and columns of a chunk are transformed independently of each other.
+void gatherVulkanFFTOutOfCoreChunk(VulkanFFTOutOfCoreStep* step, uint64_t chunk, float* staging) {
+    uint64_t begin[2], end[2];
+    vulkanFFTOutOfCoreChunkRange(step, chunk, begin, end);
+    for(uint64_t o = begin[0]; o < end[0]; ++o) {
+        float* dst = &staging[2 * (o - begin[0]) * step->length * step->innerChunkSize];
+        const float* src = &step->input[2 * (o * step->length * step->innerCount + begin[1])];
+        if(end[1] - begin[1] == step->innerCount)
+            memcpy(dst, src, sizeof(float) * 2 * step->length * step->innerCount);
+        else for(uint64_t l = 0; l < step->length; ++l)
+            memcpy(&dst[2 * l * step->innerChunkSize], &src[2 * l * step->innerCount], sizeof(float) * 2 * (end[1] - begin[1]));
+    }
+}
+
+void scatterVulkanFFTOutOfCoreChunk(VulkanFFTOutOfCoreStep* step, uint64_t chunk, const float* staging, double directionFactor) {
+    uint64_t begin[2], end[2];
+    vulkanFFTOutOfCoreChunkRange(step, chunk, begin, end);
+    for(uint64_t o = begin[0]; o < end[0]; ++o) {
+        const float* src = &staging[2 * (o - begin[0]) * step->length * step->innerChunkSize];
+        float* dst = &step->output[2 * (o * step->length * step->innerCount + begin[1])];
+        if(step->transposeRowCount) {
+            // Four-step rows: Value k1 of row k2 is X[k2 + N2 * k1]
+            uint64_t row = o / step->transposeRowCount, column = o % step->transposeRowCount;
+            dst = &step->output[2 * (row * step->length * step->transposeRowCount + column)];
+            for(uint64_t l = 0; l < step->length; ++l)
+                memcpy(&dst[2 * l * step->transposeRowCount], &src[2 * l], sizeof(float) * 2);
+        } else if(step->twiddleSampleCount) {
+            // Four-step columns: Multiply value k2 of column n1 with w^(n1 * k2), recalculated every few values to bound the rounding error
+            for(uint64_t l = 0; l < step->length; ++l) {
+                double stepAngle = directionFactor * 2.0 * M_PI * (double)l / step->twiddleSampleCount;
+                double stepW[2] = {cos(stepAngle), sin(stepAngle)};
+                for(uint64_t i = begin[1]; i < end[1]; i += 64) {
+                    double angle = directionFactor * 2.0 * M_PI * (double)(i * l % step->twiddleSampleCount) / step->twiddleSampleCount;
+                    double w[2] = {cos(angle), sin(angle)};
+                    for(uint64_t j = i; j < i + 64 && j < end[1]; ++j) {
+                        const float* value = &src[2 * (l * step->innerChunkSize + j - begin[1])];
+                        float* result = &dst[2 * (l * step->innerCount + j - begin[1])];
+                        result[0] = (float)(value[0] * w[0] - value[1] * w[1]);
+                        result[1] = (float)(value[0] * w[1] + value[1] * w[0]);
+                        double next = w[0] * stepW[0] - w[1] * stepW[1];
+                        w[1] = w[0] * stepW[1] + w[1] * stepW[0];
+                        w[0] = next;
+                    }
+                }
+            }
+        } else if(end[1] - begin[1] == step->innerCount)
+            memcpy(dst, src, sizeof(float) * 2 * step->length * step->innerCount);
+        else for(uint64_t l = 0; l < step->length; ++l)
+            memcpy(&dst[2 * l * step->innerCount], &src[2 * l * step->innerChunkSize], sizeof(float) * 2 * (end[1] - begin[1]));
+    }
+}
+
+void finishVulkanFFTOutOfCoreSlot(VulkanFFTOutOfCoreStep* step, VulkanFFTOutOfCoreSlot* slot, double directionFactor) {
+    if(!slot->pending)
+        return;
+    VulkanFFTContext* context = slot->plan.context;
+    assert(vkWaitForFences(context->device, 1, &slot->fence, VK_TRUE, 100000000000) == VK_SUCCESS);
+    assert(vkResetFences(context->device, 1, &slot->fence) == VK_SUCCESS);
+    if(slot->chunk != UINT64_MAX)
+        scatterVulkanFFTOutOfCoreChunk(step, slot->chunk, (const float*)slot->downloadData, directionFactor);
+    slot->pending = false;
+}
+
+void transformVulkanFFTOutOfCoreStep(VulkanFFTOutOfCore* vulkanFFTOutOfCores, uint32_t deviceCount, VulkanFFTOutOfCoreStep* step) {
+    // The chunk geometry is shared by all devices, so it has to respect the smallest chunk size and limits
+    uint64_t chunkValueCount = vulkanFFTOutOfCores[0].chunkSize / (sizeof(float) * 2);
+    uint32_t maxWorkGroupCount[2] = {vulkanFFTOutOfCores[0].plan.context->physicalDeviceProperties.limits.maxComputeWorkGroupCount[1], vulkanFFTOutOfCores[0].plan.context->physicalDeviceProperties.limits.maxComputeWorkGroupCount[2]};
+    for(uint32_t i = 0; i < deviceCount; ++i) {
+        const VkPhysicalDeviceLimits* limits = &vulkanFFTOutOfCores[i].plan.context->physicalDeviceProperties.limits;
+        if(vulkanFFTOutOfCores[i].chunkSize / (sizeof(float) * 2) < chunkValueCount)
+            chunkValueCount = vulkanFFTOutOfCores[i].chunkSize / (sizeof(float) * 2);
+        for(uint32_t j = 0; j < COUNT_OF(maxWorkGroupCount); ++j)
+            if(limits->maxComputeWorkGroupCount[j + 1] < maxWorkGroupCount[j])
+                maxWorkGroupCount[j] = limits->maxComputeWorkGroupCount[j + 1];
+    }
+    if(step->length * step->innerCount <= chunkValueCount) {
+        step->innerChunkSize = step->innerCount;
+        step->outerChunkSize = chunkValueCount / (step->length * step->innerCount);
+    } else {
+        assert(step->length <= chunkValueCount);
+        step->innerChunkSize = chunkValueCount / step->length;
+        step->outerChunkSize = 1;
+    }
+    // Every device gets at least one chunk if possible
+    if(step->outerChunkSize > (step->outerCount + deviceCount - 1) / deviceCount)
+        step->outerChunkSize = (step->outerCount + deviceCount - 1) / deviceCount;
+    if(step->outerCount < deviceCount) {
+        uint64_t innerChunkCount = (deviceCount + step->outerCount - 1) / step->outerCount;
+        if(step->innerChunkSize > (step->innerCount + innerChunkCount - 1) / innerChunkCount)
+            step->innerChunkSize = (step->innerCount + innerChunkCount - 1) / innerChunkCount;
+    }
+    bool columns = step->innerCount > 1;
+    if(columns) {
+        // Columns: The staged inner values are the x axis of the chunk plan, it is not transformed and dispatched coalesced
+        if(step->innerChunkSize > maxWorkGroupCount[0])
+            step->innerChunkSize = maxWorkGroupCount[0];
+        step->sampleCount[0] = (uint32_t)step->innerChunkSize;
+        step->sampleCount[1] = (uint32_t)step->length;
+        step->sampleCount[2] = 1;
+    }
+    uint32_t maxSampleCount = 1;
+    for(uint32_t i = 0; i < COUNT_OF(step->sampleCount); ++i)
+        if(step->sampleCount[i] > maxSampleCount)
+            maxSampleCount = step->sampleCount[i];
+    // The rows of all transforms in a chunk are dispatched in the z dimension
+    if(step->outerChunkSize > maxWorkGroupCount[1] / maxSampleCount)
+        step->outerChunkSize = maxWorkGroupCount[1] / maxSampleCount;
+    if(step->outerChunkSize > step->outerCount)
+        step->outerChunkSize = step->outerCount;
+    assert(step->outerChunkSize > 0 && step->innerChunkSize > 0);
+
+    for(uint32_t i = 0; i < deviceCount; ++i)
+        for(uint32_t j = 0; j < vulkanFFTOutOfCores[i].slotCount; ++j) {
+            VulkanFFTPlan* vulkanFFTPlan = &vulkanFFTOutOfCores[i].slots[j].plan;
+            *vulkanFFTPlan = vulkanFFTOutOfCores[i].plan;
+            vulkanFFTPlan->profile = false;
+            memset(&vulkanFFTPlan->input, 0, sizeof(VulkanFFTBufferLayout));
+            memset(&vulkanFFTPlan->output, 0, sizeof(VulkanFFTBufferLayout));
+            for(uint32_t k = 0; k < COUNT_OF(vulkanFFTPlan->axes); ++k) {
+                vulkanFFTPlan->axes[k].sampleCount = step->sampleCount[k];
+                vulkanFFTPlan->axes[k].skip = columns && k == 0;
+            }
+            vulkanFFTPlan->coalesced |= columns;
+            // The chunk size already accounts for two device buffers per slot, so chunk plans are never in place,
+            // and the slots run concurrently, so they can not share scratch buffers
+            vulkanFFTPlan->inPlace = false;
+            vulkanFFTPlan->shareScratch = false;
+            vulkanFFTPlan->batchCount = (uint32_t)step->outerChunkSize;
+            createVulkanFFT(vulkanFFTPlan);
+        }
+    for(uint32_t i = 0; i < deviceCount; ++i)
+        for(uint32_t j = 0; j < vulkanFFTOutOfCores[i].slotCount; ++j) {
+            VulkanFFTOutOfCoreSlot* slot = &vulkanFFTOutOfCores[i].slots[j];
+            VulkanFFTPlan* previousPlan = &vulkanFFTOutOfCores[i].slots[(j + vulkanFFTOutOfCores[i].slotCount - 1) % vulkanFFTOutOfCores[i].slotCount].plan;
+            slot->commandBuffer = recordVulkanFFTSlot(&slot->plan, slot->uploadBuffer, previousPlan, slot->downloadBuffer, true);
+            slot->downloadCommandBuffer = recordVulkanFFTSlot(&slot->plan, slot->uploadBuffer, previousPlan, slot->downloadBuffer, false);
+        }
+
+    // The chunks are distributed round robin over the devices, every device runs through its slots and waits for the submission of a slot before reusing it,
+    // so the host copies overlap with the device and the uploads overlap with the transforms of the previous slot.
+    // The result of a chunk arrives with the submission of the next slot, one more submission per device only downloads the last one.
+    double directionFactor = (vulkanFFTOutOfCores[0].plan.inverse) ? -1.0 : 1.0;
+    uint64_t chunkCount = (step->outerCount + step->outerChunkSize - 1) / step->outerChunkSize * ((step->innerCount + step->innerChunkSize - 1) / step->innerChunkSize);
+    for(uint64_t round = 0; round * deviceCount < chunkCount + deviceCount; ++round)
+        for(uint32_t i = 0; i < deviceCount; ++i) {
+            uint64_t chunk = round * deviceCount + i;
+            bool transform = chunk < chunkCount;
+            if(!transform && (round == 0 || chunk - deviceCount >= chunkCount))
+                continue;
+            VulkanFFTOutOfCore* vulkanFFTOutOfCore = &vulkanFFTOutOfCores[i];
+            VulkanFFTOutOfCoreSlot* slot = &vulkanFFTOutOfCore->slots[round % vulkanFFTOutOfCore->slotCount];
+            finishVulkanFFTOutOfCoreSlot(step, slot, directionFactor);
+            if(transform)
+                gatherVulkanFFTOutOfCoreChunk(step, chunk, (float*)slot->uploadData);
+            VkSubmitInfo submitInfo = {0};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = (transform) ? &slot->commandBuffer : &slot->downloadCommandBuffer;
+            assert(vkQueueSubmit(vulkanFFTOutOfCore->plan.context->queue, 1, &submitInfo, slot->fence) == VK_SUCCESS);
+            slot->chunk = (round > 0) ? chunk - deviceCount : UINT64_MAX;
+            slot->pending = true;
+        }
+    for(uint32_t i = 0; i < deviceCount; ++i)
+        for(uint32_t j = 0; j < vulkanFFTOutOfCores[i].slotCount; ++j) {
+            VulkanFFTOutOfCoreSlot* slot = &vulkanFFTOutOfCores[i].slots[j];
+            VulkanFFTContext* context = vulkanFFTOutOfCores[i].plan.context;
+            finishVulkanFFTOutOfCoreSlot(step, slot, directionFactor);
+            VkCommandBuffer commandBuffers[2] = {slot->commandBuffer, slot->downloadCommandBuffer};
+            vkFreeCommandBuffers(context->device, context->commandPool, COUNT_OF(commandBuffers), commandBuffers);
+            slot->commandBuffer = slot->downloadCommandBuffer = VK_NULL_HANDLE;
+            destroyVulkanFFT(&slot->plan);
+        }
+}
+
+void transformVulkanFFTMultiDevice(VulkanFFTOutOfCore* vulkanFFTOutOfCores, uint32_t deviceCount, void* input, void* output) {
+    // Complex single precision values in host memory, input and output may be the same unless the x axis has to be split (four-step).
+    // All devices have the same plan apart from the context, the host memory is used to exchange the data between the steps.
+    VulkanFFTPlan* plan = &vulkanFFTOutOfCores[0].plan;
+    uint64_t chunkValueCount = vulkanFFTOutOfCores[0].chunkSize / (sizeof(float) * 2);
+    for(uint32_t i = 1; i < deviceCount; ++i) {
+        assert(vulkanFFTOutOfCores[i].plan.inverse == plan->inverse && vulkanFFTOutOfCores[i].plan.batchCount == plan->batchCount);
+        for(uint32_t j = 0; j < COUNT_OF(plan->axes); ++j)
+            assert(vulkanFFTOutOfCores[i].plan.axes[j].sampleCount == plan->axes[j].sampleCount);
+        if(vulkanFFTOutOfCores[i].chunkSize / (sizeof(float) * 2) < chunkValueCount)
+            chunkValueCount = vulkanFFTOutOfCores[i].chunkSize / (sizeof(float) * 2);
+    }
+    uint64_t sampleCount[3] = {plan->axes[0].sampleCount, plan->axes[1].sampleCount, plan->axes[2].sampleCount};
+    // Multiple devices split the data into slabs along the slowest axis, which is transformed afterwards
+    uint32_t slabAxisLimit = COUNT_OF(sampleCount);
+    if(deviceCount > 1)
+        while(slabAxisLimit > 1 && sampleCount[slabAxisLimit - 1] == 1)
+            --slabAxisLimit;
+    if(deviceCount > 1 && slabAxisLimit > 1)
+        --slabAxisLimit;
+    // The lowest axes are transformed together in slabs of whole planes
+    uint32_t slabAxisCount = 0;
+    uint64_t planeSize = 1;
+    while(slabAxisCount < slabAxisLimit && planeSize * sampleCount[slabAxisCount] <= chunkValueCount)
+        planeSize *= sampleCount[slabAxisCount++];
+    VulkanFFTOutOfCoreStep step;
+    if(slabAxisCount == 0) {
+        // Four-step: Split the x axis into N = N1 * N2, transform N1 columns of length N2, multiply by twiddle factors and transform N2 rows of length N1
+        assert(input != output);
+        uint64_t columnLength = 0;
+        for(uint64_t i = 2; i * i <= sampleCount[0]; ++i)
+            if(sampleCount[0] % i == 0 && sampleCount[0] / i <= chunkValueCount)
+                columnLength = i;
+        assert(columnLength > 0);
+        memset(&step, 0, sizeof(step));
+        step.input = step.output = (float*)input;
+        step.outerCount = sampleCount[1] * sampleCount[2] * plan->batchCount;
+        step.length = columnLength;
+        step.innerCount = sampleCount[0] / columnLength;
+        step.twiddleSampleCount = sampleCount[0];
+        transformVulkanFFTOutOfCoreStep(vulkanFFTOutOfCores, deviceCount, &step);
+        memset(&step, 0, sizeof(step));
+        step.input = (float*)input;
+        step.output = (float*)output;
+        step.outerCount = sampleCount[1] * sampleCount[2] * plan->batchCount * columnLength;
+        step.length = sampleCount[0] / columnLength;
+        step.innerCount = 1;
+        step.sampleCount[0] = (uint32_t)step.length;
+        step.sampleCount[1] = step.sampleCount[2] = 1;
+        step.transposeRowCount = columnLength;
+        transformVulkanFFTOutOfCoreStep(vulkanFFTOutOfCores, deviceCount, &step);
+        slabAxisCount = 1;
+    } else {
+        memset(&step, 0, sizeof(step));
+        step.input = (float*)input;
+        step.output = (float*)output;
+        step.outerCount = plan->batchCount;
+        for(uint32_t i = 0; i < COUNT_OF(sampleCount); ++i) {
+            step.sampleCount[i] = (i < slabAxisCount) ? (uint32_t)sampleCount[i] : 1;
+            if(i >= slabAxisCount)
+                step.outerCount *= sampleCount[i];
+        }
+        step.length = planeSize;
+        step.innerCount = 1;
+        transformVulkanFFTOutOfCoreStep(vulkanFFTOutOfCores, deviceCount, &step);
+    }
+    // The remaining axes are transformed in place in chunks of columns
+    for(uint32_t axis = slabAxisCount; axis < COUNT_OF(sampleCount); ++axis) {
+        if(sampleCount[axis] == 1)
+            continue;
+        memset(&step, 0, sizeof(step));
+        step.input = step.output = (float*)output;
+        step.outerCount = plan->batchCount;
+        step.innerCount = 1;
+        for(uint32_t i = 0; i < COUNT_OF(sampleCount); ++i) {
+            if(i < axis)
+                step.innerCount *= sampleCount[i];
+            else if(i > axis)
+                step.outerCount *= sampleCount[i];
+        }
+        step.length = sampleCount[axis];
+        transformVulkanFFTOutOfCoreStep(vulkanFFTOutOfCores, deviceCount, &step);
+    }
+}
+
+void transformVulkanFFTOutOfCore(VulkanFFTOutOfCore* vulkanFFTOutOfCore, void* input, void* output) {
+    transformVulkanFFTMultiDevice(vulkanFFTOutOfCore, 1, input, output);
+}
+
+void destroyVulkanFFTOutOfCore(VulkanFFTOutOfCore* vulkanFFTOutOfCore) {
+    VulkanFFTContext* context = vulkanFFTOutOfCore->plan.context;
+    for(uint32_t i = 0; i < vulkanFFTOutOfCore->slotCount; ++i) {
+        VulkanFFTOutOfCoreSlot* slot = &vulkanFFTOutOfCore->slots[i];
+        vkDestroyFence(context->device, slot->fence, context->allocator);
+        vkUnmapMemory(context->device, slot->uploadDeviceMemory);
+        vkUnmapMemory(context->device, slot->downloadDeviceMemory);
+        vkDestroyBuffer(context->device, slot->uploadBuffer, context->allocator);
+        vkDestroyBuffer(context->device, slot->downloadBuffer, context->allocator);
+        vkFreeMemory(context->device, slot->uploadDeviceMemory, context->allocator);
+        vkFreeMemory(context->device, slot->downloadDeviceMemory, context->allocator);
     }
+    free(vulkanFFTOutOfCore->slots);
 }
@@ -0,0 +1,402 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#ifdef WIN32
+#define sscanf sscanf_s
+#endif
+extern "C" {
+#include "VulkanFFT.h"
+}
+#define COUNT_OF(array) (sizeof(array) / sizeof(array[0]))
+
+
+
+typedef std::complex<double> Complex;
+
+enum OutputFormat {
+    JSON,
+    CSV
+};
+
+typedef struct {
+    uint32_t extent[3];
+} BenchCase;
+
+// Powers of two, the other radices, large prime factors (Bluestein) and 2D / 3D shapes
+const BenchCase benchCases[] = {
+    {{256, 1, 1}}, {{1024, 1, 1}}, {{4096, 1, 1}}, {{16384, 1, 1}}, {{65536, 1, 1}}, {{1048576, 1, 1}},
+    {{1000, 1, 1}}, {{1536, 1, 1}}, {{2187, 1, 1}}, {{2401, 1, 1}}, {{4097, 1, 1}}, {{10007, 1, 1}},
+    {{256, 256, 1}}, {{1024, 1024, 1}}, {{640, 480, 1}},
+    {{64, 64, 64}}, {{128, 128, 128}}, {{100, 100, 100}}
+};
+const uint32_t maxRadices[] = {8, 4, 2};
+// Small transforms are batched up to this many samples, so that every case has enough work
+const uint64_t batchSampleCount = 1 << 20;
+
+VkInstance instance;
+VulkanFFTContext context = {};
+
+void abortWithError(const char* message) {
+    fprintf(stderr, "%s\n", message);
+    exit(1);
+}
+
+// Mixed radix decimation in time in double precision, writes the n values to output contiguously
+void referenceTransform(const Complex* input, uint64_t inputStride, Complex* output, uint32_t sampleCount, const Complex* roots, uint32_t rootStep) {
+    if(sampleCount == 1) {
+        output[0] = input[0];
+        return;
+    }
+    uint32_t radix = 2;
+    while(sampleCount % radix > 0)
+        ++radix;
+    uint32_t subSampleCount = sampleCount / radix;
+    // Prime sizes are transformed directly
+    if(radix == sampleCount) {
+        for(uint32_t k = 0; k < sampleCount; ++k) {
+            Complex sum = 0.0;
+            for(uint32_t j = 0; j < sampleCount; ++j)
+                sum += input[j * inputStride] * roots[(uint64_t)j * k % sampleCount * rootStep];
+            output[k] = sum;
+        }
+        return;
+    }
+    for(uint32_t r = 0; r < radix; ++r)
+        referenceTransform(&input[r * inputStride], inputStride * radix, &output[r * subSampleCount], subSampleCount, roots, rootStep * radix);
+    std::vector<Complex> column(radix);
+    for(uint32_t k = 0; k < subSampleCount; ++k) {
+        for(uint32_t r = 0; r < radix; ++r)
+            column[r] = output[r * subSampleCount + k] * roots[(uint64_t)r * k * rootStep];
+        for(uint32_t q = 0; q < radix; ++q) {
+            Complex sum = 0.0;
+            for(uint32_t r = 0; r < radix; ++r)
+                sum += column[r] * roots[(uint64_t)r * q % radix * subSampleCount * rootStep];
+            output[q * subSampleCount + k] = sum;
+        }
+    }
+}
+
+// Same conventions as the library: The forward transform uses positive angles and is normalized, the inverse is not
+void referenceTransformAxes(std::vector<Complex>& values, const uint32_t extent[3], bool inverse) {
+    uint64_t stride = 1;
+    for(uint32_t axis = 0; axis < 3; ++axis) {
+        uint32_t sampleCount = extent[axis];
+        if(sampleCount > 1) {
+            std::vector<Complex> roots(sampleCount), line(sampleCount);
+            for(uint32_t i = 0; i < sampleCount; ++i)
+                roots[i] = std::polar(1.0, ((inverse) ? -2.0 : 2.0) * M_PI * i / sampleCount);
+            double normalizationFactor = (inverse) ? 1.0 : 1.0 / sampleCount;
+            uint64_t lineCount = values.size() / sampleCount;
+            for(uint64_t l = 0; l < lineCount; ++l) {
+                Complex* lineStart = &values[l / stride * stride * sampleCount + l % stride];
+                referenceTransform(lineStart, stride, line.data(), sampleCount, roots.data(), 1);
+                for(uint32_t k = 0; k < sampleCount; ++k)
+                    lineStart[k * stride] = line[k] * normalizationFactor;
+            }
+        }
+        stride *= sampleCount;
+    }
+}
+
+std::string stageString(VulkanFFTPlan* vulkanFFTPlan) {
+    // Radices of every transformed axis, Bluestein axes are marked with their padded size
+    std::string result;
+    for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->axes); ++i) {
+        if(!vulkanFFTPlan->axes[i].stageRadix)
+            continue;
+        if(!result.empty())
+            result += ";";
+        if(vulkanFFTPlan->axes[i].bluesteinSampleCount)
+            result += "B" + std::to_string(vulkanFFTPlan->axes[i].bluesteinSampleCount) + ":";
+        for(uint32_t j = 0; j < vulkanFFTPlan->axes[i].stageCount; ++j)
+            result += ((j > 0) ? "x" : "") + std::to_string(vulkanFFTPlan->axes[i].stageRadix[j]);
+    }
+    return result;
+}
+
+typedef struct {
+    std::string stages, axisTimes;
+    std::vector<double> times;
+    double maxError;
+} BenchResult;
+
+BenchResult runCase(VulkanFFTPlan* vulkanFFTPlan, const std::vector<std::complex<float>>& input, uint32_t warmupCount, uint32_t iterationCount) {
+    BenchResult result;
+    std::vector<std::complex<float>> output(input.size());
+    if(!createVulkanFFT(vulkanFFTPlan))
+        abortWithError("Could not create plan");
+    result.stages = stageString(vulkanFFTPlan);
+    if(vulkanFFTPlan->onHost) {
+        for(uint32_t i = 0; i < warmupCount + iterationCount; ++i) {
+            auto timeA = std::chrono::steady_clock::now();
+            transformVulkanFFTOnHost(vulkanFFTPlan, input.data(), output.data());
+            auto timeB = std::chrono::steady_clock::now();
+            if(i >= warmupCount)
+                result.times.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(timeB-timeA).count()*0.001);
+        }
+    } else {
+        // The input is kept in a separate buffer and copied into the plan before every iteration outside of the timed region,
+        // so that every submission transforms the same data instead of growing (inverse) or shrinking (forward) the previous result into inf, NaN or denormals
+        VkBuffer inputBuffer;
+        allocateVulkanFFTBuffer(&context, &inputBuffer, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, vulkanFFTPlan->bufferSize, NULL);
+        VkCommandBuffer restoreCommandBuffer = createCommandBuffer(&context, 0);
+        VkBufferCopy bufferCopy = {};
+        bufferCopy.size = vulkanFFTPlan->bufferSize;
+        vkCmdCopyBuffer(restoreCommandBuffer, inputBuffer, vulkanFFTPlan->buffer[0], 1, &bufferCopy);
+        vkEndCommandBuffer(restoreCommandBuffer);
+        // The plan is warm: Pipelines, tables and the command buffer are created once and the command buffer is resubmitted for every iteration
+        VkCommandBuffer commandBuffer = createCommandBuffer(&context, 0);
+        VkMemoryBarrier memoryBarrier = {};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+        recordVulkanFFT(vulkanFFTPlan, commandBuffer);
+        vkEndCommandBuffer(commandBuffer);
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        VkSubmitInfo restoreSubmitInfo = submitInfo;
+        restoreSubmitInfo.pCommandBuffers = &restoreCommandBuffer;
+        VulkanFFTTransfer vulkanFFTTransfer;
+        vulkanFFTTransfer.context = &context;
+        vulkanFFTTransfer.size = vulkanFFTPlan->bufferSize;
+        vulkanFFTTransfer.deviceBuffer = inputBuffer;
+        // Half precision plans store the data in half precision, so the input is rounded once before the transform
+        const float* inputValues = reinterpret_cast<const float*>(input.data());
+        if(vulkanFFTPlan->halfPrecision) {
+            uint16_t* halfs = reinterpret_cast<uint16_t*>(createVulkanFFTUpload(&vulkanFFTTransfer));
+            for(size_t i = 0; i < input.size() * 2; ++i)
+                halfs[i] = floatToHalf(inputValues[i]);
+        } else
+            memcpy(createVulkanFFTUpload(&vulkanFFTTransfer), inputValues, vulkanFFTPlan->bufferSize);
+        freeVulkanFFTTransfer(&vulkanFFTTransfer);
+        for(uint32_t i = 0; i < warmupCount + iterationCount; ++i) {
+            assert(vkQueueSubmit(context.queue, 1, &restoreSubmitInfo, context.fence) == VK_SUCCESS);
+            assert(vkWaitForFences(context.device, 1, &context.fence, VK_TRUE, 100000000000) == VK_SUCCESS);
+            assert(vkResetFences(context.device, 1, &context.fence) == VK_SUCCESS);
+            auto timeA = std::chrono::steady_clock::now();
+            assert(vkQueueSubmit(context.queue, 1, &submitInfo, context.fence) == VK_SUCCESS);
+            assert(vkWaitForFences(context.device, 1, &context.fence, VK_TRUE, 100000000000) == VK_SUCCESS);
+            auto timeB = std::chrono::steady_clock::now();
+            assert(vkResetFences(context.device, 1, &context.fence) == VK_SUCCESS);
+            if(i >= warmupCount)
+                result.times.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(timeB-timeA).count()*0.001);
+            if(i == 0) {
+                vulkanFFTTransfer.deviceBuffer = vulkanFFTPlan->buffer[vulkanFFTPlan->resultInSwapBuffer];
+                if(vulkanFFTPlan->halfPrecision) {
+                    const uint16_t* halfs = reinterpret_cast<const uint16_t*>(createVulkanFFTDownload(&vulkanFFTTransfer));
+                    float* outputValues = reinterpret_cast<float*>(output.data());
+                    for(size_t j = 0; j < output.size() * 2; ++j)
+                        outputValues[j] = halfToFloat(halfs[j]);
+                } else
+                    memcpy(output.data(), createVulkanFFTDownload(&vulkanFFTTransfer), vulkanFFTPlan->bufferSize);
+                freeVulkanFFTTransfer(&vulkanFFTTransfer);
+            }
+        }
+        // GPU time of every transformed axis in the last iteration
+        if(vulkanFFTPlan->profile && queryVulkanFFTProfile(vulkanFFTPlan))
+            for(uint32_t i = 0; i < COUNT_OF(vulkanFFTPlan->axes); ++i) {
+                if(!vulkanFFTPlan->axes[i].stageRadix)
+                    continue;
+                char axisTime[32];
+                snprintf(axisTime, sizeof(axisTime), "%s%.3f", (result.axisTimes.empty()) ? "" : ";", vulkanFFTPlan->axes[i].profile.time * 0.001);
+                result.axisTimes += axisTime;
+            }
+        vkFreeCommandBuffers(context.device, context.commandPool, 1, &commandBuffer);
+        vkFreeCommandBuffers(context.device, context.commandPool, 1, &restoreCommandBuffer);
+        freeVulkanFFTBuffer(&context, inputBuffer);
+    }
+    destroyVulkanFFT(vulkanFFTPlan);
+    // Only the first transform of a batch is compared, the others are independent transforms of the same kind
+    uint32_t extent[3] = {vulkanFFTPlan->axes[0].sampleCount, vulkanFFTPlan->axes[1].sampleCount, vulkanFFTPlan->axes[2].sampleCount};
+    std::vector<Complex> reference(input.begin(), input.begin() + input.size() / vulkanFFTPlan->batchCount);
+    referenceTransformAxes(reference, extent, vulkanFFTPlan->inverse);
+    // Maximum absolute error relative to the largest magnitude of the reference
+    double maxError = 0.0, maxMagnitude = 0.0;
+    for(size_t i = 0; i < reference.size(); ++i) {
+        maxError = std::max(maxError, std::abs(Complex(output[i]) - reference[i]));
+        maxMagnitude = std::max(maxMagnitude, std::abs(reference[i]));
+    }
+    result.maxError = (maxMagnitude > 0.0) ? maxError / maxMagnitude : maxError;
+    return result;
+}
+
+int main(int argc, const char** argv) {
+    OutputFormat outputFormat = JSON;
+    uint32_t deviceIndex = 0, warmupCount = 3, iterationCount = 100;
+    unsigned long long maxSampleCount = 1 << 22;
+    // Zero for no accuracy check, otherwise the run fails if a half precision case exceeds it
+    double maxHalfError = 0.0;
+    bool halfErrorExceeded = false;
+    bool onHost = false, halfPrecision = false, coalescedAxes = false, profile = false;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--device") == 0) {
+            assert(++i < argc);
+            if(strcmp(argv[i], "cpu") == 0)
+                onHost = true;
+            else
+                sscanf(argv[i], "%d", &deviceIndex);
+        } else if(strcmp(argv[i], "--iterations") == 0) {
+            assert(++i < argc);
+            sscanf(argv[i], "%d", &iterationCount);
+            assert(iterationCount > 0);
+        } else if(strcmp(argv[i], "--warmup") == 0) {
+            assert(++i < argc);
+            sscanf(argv[i], "%d", &warmupCount);
+        } else if(strcmp(argv[i], "--max-samples") == 0) {
+            assert(++i < argc);
+            sscanf(argv[i], "%llu", &maxSampleCount);
+        } else if(strcmp(argv[i], "--half") == 0)
+            halfPrecision = true;
+        else if(strcmp(argv[i], "--max-half-error") == 0) {
+            assert(++i < argc);
+            sscanf(argv[i], "%lf", &maxHalfError);
+            assert(maxHalfError > 0.0);
+            halfPrecision = true;
+        }
+        else if(strcmp(argv[i], "--coalesced") == 0)
+            coalescedAxes = true;
+        else if(strcmp(argv[i], "--profile") == 0)
+            profile = true;
+        else if(strcmp(argv[i], "--format") == 0) {
+            assert(++i < argc);
+            if(strcmp(argv[i], "json") == 0)
+                outputFormat = JSON;
+            else if(strcmp(argv[i], "csv") == 0)
+                outputFormat = CSV;
+            else
+                abortWithError("Unknown format");
+        } else
+            fprintf(stderr, "Unrecognized option %s\n", argv[i]);
+    }
+
+    if(onHost && halfPrecision)
+        abortWithError("The CPU engine has no half precision");
+    if(onHost && (coalescedAxes || profile))
+        abortWithError("The CPU engine has no coalesced layout and no profile");
+
+    std::string deviceName = "CPU";
+    if(!onHost) {
+        // No layers or extensions are required, so software implementations like lavapipe or SwiftShader work too
+        VkInstanceCreateInfo instanceCreateInfo = {};
+        instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        VkResult result = vkCreateInstance(&instanceCreateInfo, context.allocator, &instance);
+        if(result == VK_ERROR_INCOMPATIBLE_DRIVER)
+            abortWithError("No driver found, could not create instance: Is VK_ICD_FILENAMES set correctly?");
+        assert(result == VK_SUCCESS);
+        uint32_t physicalDeviceCount = 0;
+        vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, NULL);
+        if(deviceIndex >= physicalDeviceCount)
+            abortWithError("Device index too high");
+        std::vector<VkPhysicalDevice> physicalDevices(physicalDeviceCount);
+        vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices.data());
+        context.physicalDevice = physicalDevices[deviceIndex];
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(context.physicalDevice, &deviceProperties);
+        deviceName = deviceProperties.deviceName;
+        if(profile && !deviceProperties.limits.timestampComputeAndGraphics)
+            abortWithError("The device has no timestamps for the profile");
+        VkDeviceQueueCreateInfo deviceQueueCreateInfo = {};
+        deviceQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        deviceQueueCreateInfo.queueFamilyIndex = 0;
+        deviceQueueCreateInfo.queueCount = 1;
+        float queuePriority = 1.0;
+        deviceQueueCreateInfo.pQueuePriorities = &queuePriority;
+        VkPhysicalDeviceFeatures deviceFeatures = {};
+        VkDeviceCreateInfo deviceCreateInfo = {};
+        deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        deviceCreateInfo.pQueueCreateInfos = &deviceQueueCreateInfo;
+        deviceCreateInfo.queueCreateInfoCount = 1;
+        deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
+        assert(vkCreateDevice(context.physicalDevice, &deviceCreateInfo, context.allocator, &context.device) == VK_SUCCESS);
+        vkGetDeviceQueue(context.device, deviceQueueCreateInfo.queueFamilyIndex, 0, &context.queue);
+        VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+        commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        commandPoolCreateInfo.queueFamilyIndex = 0;
+        assert(vkCreateCommandPool(context.device, &commandPoolCreateInfo, context.allocator, &context.commandPool) == VK_SUCCESS);
+        initVulkanFFTContext(&context);
+    }
+
+    if(outputFormat == JSON)
+        printf("{\n  \"device\": \"%s\",\n  \"iterations\": %d,\n  \"cases\": [", deviceName.c_str(), iterationCount);
+    else
+        printf("device,shape,batch,direction,precision,layout,maxRadix,stages,medianUs,p99Us,axisUs,gflops,gbps,maxError\n");
+    std::mt19937 random(0);
+    std::uniform_real_distribution<float> distribution(-0.5F, 0.5F);
+    bool firstCase = true;
+    for(uint32_t c = 0; c < COUNT_OF(benchCases); ++c) {
+        const BenchCase* benchCase = &benchCases[c];
+        uint64_t sampleCount = (uint64_t)benchCase->extent[0] * benchCase->extent[1] * benchCase->extent[2];
+        if(sampleCount > maxSampleCount)
+            continue;
+        uint32_t batchCount = (uint32_t)std::max((uint64_t)1, std::min(batchSampleCount, (uint64_t)maxSampleCount) / sampleCount);
+        std::vector<std::complex<float>> input(sampleCount * batchCount);
+        for(auto& value : input)
+            value = std::complex<float>(distribution(random), distribution(random));
+        char shape[64];
+        snprintf(shape, sizeof(shape), "%dx%dx%d", benchCase->extent[0], benchCase->extent[1], benchCase->extent[2]);
+        for(uint32_t inverse = 0; inverse < 2; ++inverse)
+            for(uint32_t r = 0; r < COUNT_OF(maxRadices); ++r)
+                // Every half precision and coalesced case follows the single precision strided case with the same input, so the errors and axis times can be compared directly
+                for(uint32_t variant = 0; variant < 4; ++variant) {
+                    bool half = variant & 1, coalesced = variant & 2;
+                    // The host engine has no radix 8 stages, coalesced plans only differ from strided plans along the y and z axes
+                    if((onHost && maxRadices[r] > 4) || (half && !halfPrecision) || (coalesced && (!coalescedAxes || benchCase->extent[1] == 1)))
+                        continue;
+                    VulkanFFTPlan vulkanFFTPlan = {};
+                    vulkanFFTPlan.context = &context;
+                    for(uint32_t i = 0; i < 3; ++i)
+                        vulkanFFTPlan.axes[i].sampleCount = benchCase->extent[i];
+                    vulkanFFTPlan.batchCount = batchCount;
+                    vulkanFFTPlan.inverse = inverse;
+                    vulkanFFTPlan.maxRadix = maxRadices[r];
+                    vulkanFFTPlan.onHost = onHost;
+                    vulkanFFTPlan.halfPrecision = half;
+                    vulkanFFTPlan.coalesced = coalesced;
+                    vulkanFFTPlan.profile = profile;
+                    BenchResult result = runCase(&vulkanFFTPlan, input, warmupCount, iterationCount);
+                    std::sort(result.times.begin(), result.times.end());
+                    double median = result.times[result.times.size() / 2],
+                           p99 = result.times[std::min(result.times.size() - 1, (size_t)ceil(result.times.size() * 0.99) - 1)];
+                    // 5 N log2(N) flops per transform and every complex value read and written once
+                    double totalSampleCount = (double)sampleCount * batchCount;
+                    double gigaFlopsPerSecond = 5.0 * totalSampleCount * log2((double)sampleCount) / (median * 1000.0),
+                           gigaBytesPerSecond = 2.0 * ((half) ? 4.0 : 8.0) * totalSampleCount / (median * 1000.0);
+                    const char* precision = (half) ? "half" : "single";
+                    const char* layout = (coalesced) ? "coalesced" : "strided";
+                    if(outputFormat == JSON) {
+                        printf("%s\n    {\"shape\": \"%s\", \"batch\": %d, \"direction\": \"%s\", \"precision\": \"%s\", \"layout\": \"%s\", \"maxRadix\": %d, \"stages\": \"%s\", \"medianUs\": %.3f, \"p99Us\": %.3f, \"axisUs\": \"%s\", \"gflops\": %.3f, \"gbps\": %.3f, \"maxError\": %.3e}",
+                               (firstCase) ? "" : ",", shape, batchCount, (inverse) ? "inverse" : "forward", precision, layout, maxRadices[r], result.stages.c_str(), median, p99, result.axisTimes.c_str(), gigaFlopsPerSecond, gigaBytesPerSecond, result.maxError);
+                        firstCase = false;
+                    } else
+                        printf("\"%s\",%s,%d,%s,%s,%s,%d,%s,%.3f,%.3f,%s,%.3f,%.3f,%.3e\n",
+                               deviceName.c_str(), shape, batchCount, (inverse) ? "inverse" : "forward", precision, layout, maxRadices[r], result.stages.c_str(), median, p99, result.axisTimes.c_str(), gigaFlopsPerSecond, gigaBytesPerSecond, result.maxError);
+                    fflush(stdout);
+                    // NaN and inf fail the check too
+                    if(half && maxHalfError > 0.0 && !(result.maxError <= maxHalfError)) {
+                        fprintf(stderr, "Half precision error %.3e of %s %s with maxRadix %d exceeds %.3e\n", result.maxError, shape, (inverse) ? "inverse" : "forward", maxRadices[r], maxHalfError);
+                        halfErrorExceeded = true;
+                    }
+                }
+    }
+    if(outputFormat == JSON)
+        printf("\n  ]\n}\n");
+
+    if(!onHost) {
+        freeVulkanFFTContext(&context);
+        vkDestroyCommandPool(context.device, context.commandPool, context.allocator);
+        vkDestroyDevice(context.device, NULL);
+        vkDestroyInstance(instance, NULL);
+    }
+    return (halfErrorExceeded) ? 1 : 0;
+}
@@ -4,14 +4,26 @@
 #include <string.h>
 #include <complex>
 #include <chrono>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cfloat>
+#include <cmath>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #ifdef HAS_PNG
 #include <libpng16/png.h>
+#include <zlib.h>
 #endif
 #ifdef HAS_EXR
 #include <OpenEXR/ImfFrameBuffer.h>
 #include <OpenEXR/ImfChannelList.h>
 #include <OpenEXR/ImfInputFile.h>
 #include <OpenEXR/ImfOutputFile.h>
+#include <OpenEXR/ImfThreading.h>
 #endif
 #ifdef WIN32
 #define fscanf fscanf_s
@@ -39,12 +51,22 @@ enum IOType {
 typedef struct {
     IOType type;
     FILE* file;
+    const char* fileName;
+    // Raw files in the layout of the buffers are mapped instead of read and written through the file
+    void* map;
+    size_t mapSize;
+    // ASCII is read in chunks, the text of the next frame starts at the offset
+    std::vector<char> text;
+    size_t textOffset;
 } DataStream;
 DataStream inputStream = {ASCII}, outputStream = {ASCII};
 
 VkInstance instance;
 VulkanFFTContext context = {};
 VulkanFFTPlan vulkanFFTPlan = {&context};
+VulkanFFTVisualization visualization = {&vulkanFFTPlan};
+bool hostMemoryImport = false, shortestNumbers = false, visualizeOutput = false;
+size_t mapAlignment = 0;
 
 #ifndef NDEBUG
 VkDebugUtilsMessengerEXT debugMessenger;
@@ -62,34 +84,261 @@ void abortWithError(const char* message) {
     exit(1);
 }
 
+uint32_t hardwareThreadCount() {
+    return std::max(1U, std::thread::hardware_concurrency());
+}
+
+// Splits [0, count) into one contiguous range per thread, the ranges are in the order of the thread indices
+template<typename Function>
+void parallelRanges(size_t count, size_t minimumPerThread, Function function) {
+    uint32_t threadCount = (uint32_t)std::max((size_t)1, std::min((size_t)hardwareThreadCount(), count / std::max(minimumPerThread, (size_t)1)));
+    size_t share = (count + threadCount - 1) / threadCount;
+    std::vector<std::thread> threads;
+    for(uint32_t i = 1; i < threadCount && share * i < count; ++i)
+        threads.push_back(std::thread(function, i, share * i, std::min(count, share * (i + 1))));
+    function(0, 0, std::min(count, share));
+    for(auto& thread : threads)
+        thread.join();
+}
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+const int32_t maxPowerOfTen = 64;
+
+// Correctly rounded powers of ten for the decimal conversions
+double powerOfTen(int32_t exponent) {
+    static const std::vector<double> powers = []() {
+        std::vector<double> powers;
+        for(int32_t i = 0; i <= maxPowerOfTen; ++i)
+            powers.push_back(strtod(("1e" + std::to_string(i)).c_str(), NULL));
+        return powers;
+    }();
+    return (exponent >= 0) ? powers[exponent] : 1.0 / powers[-exponent];
+}
+
+// Converts mantissa * 10^exponent in double precision, which is at most a few ulps off,
+// so rounding it to float is only ambiguous next to the middle between two floats (or outside of the normal range)
+bool decimalToFloat(uint64_t mantissa, int32_t exponent, float* result) {
+    if(exponent < -maxPowerOfTen || exponent > maxPowerOfTen)
+        return false;
+    double value = (exponent >= 0) ? (double)mantissa * powerOfTen(exponent) : (double)mantissa / powerOfTen(-exponent);
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int64_t distanceToMiddle = (int64_t)(bits & 0x1FFFFFFF) - 0x10000000;
+    if(distanceToMiddle >= -16 && distanceToMiddle <= 16)
+        return false;
+    if(value != 0.0 && (value < 2.0 * FLT_MIN || value > 0.5 * FLT_MAX))
+        return false;
+    *result = (float)value;
+    return true;
+}
+
+// Parses the next number of the text and skips to the end of its token,
+// the first 19 significant digits are converted with decimalToFloat if possible, otherwise strtof is used
+float parseFloat(const char** text) {
+    const char* c = *text;
+    while(isSpace(*c))
+        ++c;
+    const char* begin = c;
+    bool negative = (*c == '-'), digits = false;
+    if(*c == '-' || *c == '+')
+        ++c;
+    uint64_t mantissa = 0;
+    int32_t exponent = 0, significantDigits = 0;
+    for(; *c >= '0' && *c <= '9'; ++c, digits = true)
+        if(significantDigits < 19) {
+            mantissa = mantissa * 10 + (*c - '0');
+            significantDigits += (mantissa > 0);
+        } else
+            ++exponent;
+    if(*c == '.')
+        for(++c; *c >= '0' && *c <= '9'; ++c, digits = true)
+            if(significantDigits < 19) {
+                mantissa = mantissa * 10 + (*c - '0');
+                significantDigits += (mantissa > 0);
+                --exponent;
+            }
+    if(digits && (*c == 'e' || *c == 'E')) {
+        const char* exponentBegin = c++;
+        bool negativeExponent = (*c == '-');
+        if(*c == '-' || *c == '+')
+            ++c;
+        int32_t value = 0;
+        if(*c < '0' || *c > '9')
+            c = exponentBegin;
+        for(; *c >= '0' && *c <= '9'; ++c)
+            value = std::min(value * 10 + (*c - '0'), 10000);
+        exponent += (negativeExponent) ? -value : value;
+    }
+    float result;
+    if(digits && (*c == 0 || isSpace(*c)) && decimalToFloat(mantissa, exponent, &result)) {
+        *text = c;
+        return (negative) ? -result : result;
+    }
+    char* end;
+    result = strtof(begin, &end);
+    for(c = end; *c != 0 && !isSpace(*c); ++c);
+    if(end == begin || c != end)
+        abortWithError("Could not parse ASCII input");
+    *text = c;
+    return result;
+}
+
+// Writes mantissa * 10^exponent without trailing zeros, in positional notation if that is not much longer
+size_t formatDecimal(char* text, size_t textSize, bool negative, uint64_t mantissa, int32_t exponent) {
+    for(; mantissa >= 10 && mantissa % 10 == 0; mantissa /= 10, ++exponent);
+    char digits[24];
+    int32_t length = 0;
+    for(uint64_t rest = mantissa; rest > 0 || length == 0; rest /= 10, ++length)
+        digits[length] = '0' + rest % 10;
+    std::reverse(digits, digits + length);
+    int32_t pointPosition = length + exponent;
+    const char* sign = (negative) ? "-" : "";
+    if(exponent >= 0 && pointPosition <= 9)
+        return snprintf(text, textSize, "%s%.*s%.*s", sign, length, digits, exponent, "000000000");
+    if(exponent < 0 && pointPosition > 0)
+        return snprintf(text, textSize, "%s%.*s.%.*s", sign, pointPosition, digits, -exponent, &digits[pointPosition]);
+    if(pointPosition > -4 && pointPosition <= 0)
+        return snprintf(text, textSize, "%s0.%.*s%.*s", sign, -pointPosition, "000", length, digits);
+    return snprintf(text, textSize, "%s%c%s%.*se%d", sign, digits[0], (length > 1) ? "." : "", length - 1, &digits[1], pointPosition - 1);
+}
+
+// Writes either 24 fractional digits or the fewest significant digits which parse to the same float
+size_t formatFloat(char* text, size_t textSize, float value) {
+    if(!shortestNumbers)
+        return snprintf(text, textSize, "%.24f", value);
+    if(value == 0.0f || !std::isfinite(value))
+        return snprintf(text, textSize, "%g", value);
+    double magnitude = fabs(value);
+    int32_t leadingExponent = (int32_t)floor(log10(magnitude));
+    // Rounds to a number of significant digits and checks if that parses to the same float, searching the fewest digits
+    auto roundTrips = [&](int32_t digitCount) {
+        int32_t exponent = leadingExponent + 1 - digitCount;
+        uint64_t mantissa = llround(magnitude * powerOfTen(-exponent));
+        float result;
+        if(decimalToFloat(mantissa, exponent, &result))
+            return result == (float)magnitude;
+        formatDecimal(text, textSize, false, mantissa, exponent);
+        return strtof(text, NULL) == (float)magnitude;
+    };
+    int32_t lowerDigitCount = 1, upperDigitCount = 9;
+    while(lowerDigitCount < upperDigitCount) {
+        int32_t digitCount = (lowerDigitCount + upperDigitCount) / 2;
+        if(roundTrips(digitCount))
+            upperDigitCount = digitCount;
+        else
+            lowerDigitCount = digitCount + 1;
+    }
+    if(!roundTrips(upperDigitCount))
+        return snprintf(text, textSize, "%.9g", value);
+    int32_t exponent = leadingExponent + 1 - upperDigitCount;
+    return formatDecimal(text, textSize, value < 0.0f, llround(magnitude * powerOfTen(-exponent)), exponent);
+}
+
+// Appends the next chunk of the file to the text, which always ends with a null character for the parser
+bool readTextChunk(DataStream* dataStream) {
+    const size_t chunkSize = 1 << 24;
+    auto& text = dataStream->text;
+    if(text.empty())
+        text.push_back(0);
+    size_t size = text.size() - 1;
+    text.resize(size + chunkSize + 1);
+    size_t readSize = fread(&text[size], 1, chunkSize, dataStream->file);
+    text.resize(size + readSize + 1);
+    text.back() = 0;
+    return readSize > 0;
+}
+
+// Finds the beginning of every segment of values of the next frame, reading as much of the file as needed,
+// then the segments are parsed in parallel
+void scanTextFrame(DataStream* dataStream, size_t valueCount, size_t segmentLength, std::vector<size_t>* segmentOffsets) {
+    auto& text = dataStream->text;
+    if(text.empty())
+        readTextChunk(dataStream);
+    text.erase(text.begin(), text.begin() + dataStream->textOffset);
+    size_t position = 0;
+    for(size_t valueIndex = 0; valueIndex < valueCount; ++valueIndex) {
+        while(position + 1 < text.size() || readTextChunk(dataStream)) {
+            if(!isSpace(text[position]))
+                break;
+            ++position;
+        }
+        if(position + 1 == text.size())
+            abortWithError("Unexpected end of ASCII input");
+        if(valueIndex % segmentLength == 0)
+            segmentOffsets->push_back(position);
+        while(position + 1 < text.size() || readTextChunk(dataStream)) {
+            if(isSpace(text[position]))
+                break;
+            ++position;
+        }
+    }
+    dataStream->textOffset = position;
+}
+
 #ifdef HAS_EXR
-Imf::FrameBuffer frameBufferForEXR(float* image, uint32_t width) {
+Imf::FrameBuffer frameBufferForEXR(float* image, uint32_t rowStride, bool realValues) {
     Imf::FrameBuffer frameBuffer;
-    uint32_t xStride = 2*sizeof(float);
-    uint32_t yStride = width*2*sizeof(float);
+    uint32_t xStride = (realValues ? 1 : 2)*sizeof(float);
+    uint32_t yStride = rowStride*2*sizeof(float);
     frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, (char*)&image[0], xStride, yStride));
-    frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, (char*)&image[1], xStride, yStride));
+    if(!realValues)
+        frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, (char*)&image[1], xStride, yStride));
     return frameBuffer;
 }
 #endif
 
-void readDataStream(DataStream* dataStream, VulkanFFTPlan* vulkanFFT) {
-    VulkanFFTTransfer vulkanFFTTransfer;
-    vulkanFFTTransfer.context = &context;
-    vulkanFFTTransfer.size = vulkanFFTPlan.bufferSize;
-    vulkanFFTTransfer.deviceBuffer = vulkanFFTPlan.buffer[0];
-    auto data = reinterpret_cast<std::complex<float>*>(createVulkanFFTUpload(&vulkanFFTTransfer));
+// Real transforms pad every row to n/2+1 complex values, real samples are packed at the beginning of a row
+uint32_t complexRowLength() {
+    return (vulkanFFTPlan.realTransform) ? vulkanFFTPlan.axes[0].sampleCount / 2 + 1 : vulkanFFTPlan.axes[0].sampleCount;
+}
+
+// Skips whitespace between frames and checks if there is another one
+bool hasNextFrame(DataStream* dataStream) {
+    if(dataStream->type == ASCII) {
+        auto& text = dataStream->text;
+        if(text.empty())
+            readTextChunk(dataStream);
+        while(dataStream->textOffset + 1 < text.size() || readTextChunk(dataStream)) {
+            if(!isSpace(text[dataStream->textOffset]))
+                return true;
+            ++dataStream->textOffset;
+        }
+        return false;
+    }
+    int c = fgetc(dataStream->file);
+    if(c == EOF)
+        return false;
+    ungetc(c, dataStream->file);
+    return true;
+}
+
+void readFrame(DataStream* dataStream, std::complex<float>* data) {
+    bool realValues = vulkanFFTPlan.realTransform && !vulkanFFTPlan.inverse;
+    uint32_t rowStride = complexRowLength(),
+             rowLength = (realValues) ? vulkanFFTPlan.axes[0].sampleCount : rowStride,
+             rowCount = vulkanFFTPlan.axes[1].sampleCount * vulkanFFTPlan.axes[2].sampleCount * vulkanFFTPlan.batchCount,
+             valueSize = (realValues) ? sizeof(float) : sizeof(std::complex<float>);
     switch(dataStream->type) {
         case RAW:
-            assert(fread(data, 1, (size_t)vulkanFFTPlan.bufferSize, dataStream->file) == vulkanFFTPlan.bufferSize);
+            for(uint32_t y = 0; y < rowCount; ++y)
+                assert(fread(&data[rowStride * y], valueSize, rowLength, dataStream->file) == rowLength);
             break;
-        case ASCII:
-            for(uint32_t i = 0; i < vulkanFFTPlan.axes[0].sampleCount * vulkanFFTPlan.axes[1].sampleCount * vulkanFFTPlan.axes[2].sampleCount; ++i) {
-                float real, imag;
-                fscanf(dataStream->file, "%f %f", &real, &imag);
-                data[i] = std::complex<float>(real, imag);
-            }
-        break;
+        case ASCII: {
+            const size_t segmentLength = 1 << 16, rowValueCount = rowLength * valueSize / sizeof(float), valueCount = rowValueCount * rowCount;
+            std::vector<size_t> segmentOffsets;
+            scanTextFrame(dataStream, valueCount, segmentLength, &segmentOffsets);
+            auto values = reinterpret_cast<float*>(data);
+            parallelRanges(segmentOffsets.size(), 1, [&](uint32_t thread, size_t begin, size_t end) {
+                for(size_t segment = begin; segment < end; ++segment) {
+                    const char* text = &dataStream->text[segmentOffsets[segment]];
+                    for(size_t i = segment * segmentLength; i < std::min(valueCount, (segment + 1) * segmentLength); ++i)
+                        values[i / rowValueCount * rowStride * 2 + i % rowValueCount] = parseFloat(&text);
+                }
+            });
+        } break;
 #ifdef HAS_PNG
         case PNG: {
             png_byte pngsig[8];
@@ -113,17 +362,20 @@ void readDataStream(DataStream* dataStream, VulkanFFTPlan* vulkanFFT) {
             png_uint_32 width, height;
             int bitdepth, colorType;
             png_get_IHDR(pngPtr, infoPtr, &width, &height, &bitdepth, &colorType, NULL, NULL, NULL);
-            assert(vulkanFFTPlan.axes[0].sampleCount == width && vulkanFFTPlan.axes[1].sampleCount == height && vulkanFFTPlan.axes[2].sampleCount == 1);
+            assert(rowLength == width && vulkanFFTPlan.axes[1].sampleCount == height && vulkanFFTPlan.axes[2].sampleCount == 1 && vulkanFFTPlan.batchCount == 1);
             assert(bitdepth == 8 && colorType == PNG_COLOR_TYPE_GRAY);
             for(uint32_t y = 0; y < vulkanFFTPlan.axes[1].sampleCount; ++y)
-                rowPtrs[y] = (png_byte*)&data[vulkanFFTPlan.axes[0].sampleCount * y];
+                rowPtrs[y] = (png_byte*)&data[rowStride * y];
             png_set_swap(pngPtr);
             png_read_image(pngPtr, rowPtrs);
             for(uint32_t y = 0; y < vulkanFFTPlan.axes[1].sampleCount; ++y) {
-                uint32_t yOffset = vulkanFFTPlan.axes[0].sampleCount * y;
+                uint32_t yOffset = rowStride * y;
                 Pixel* row = (Pixel*)&data[yOffset];
-                for(int32_t x = vulkanFFTPlan.axes[0].sampleCount-1; x >= 0; --x)
-                    data[x + yOffset] = (float)row[x] / 256.0;
+                for(int32_t x = rowLength-1; x >= 0; --x)
+                    if(realValues)
+                        reinterpret_cast<float*>(row)[x] = (float)row[x] / 256.0;
+                    else
+                        data[x + yOffset] = (float)row[x] / 256.0;
             }
             png_read_end(pngPtr, NULL);
             free(rowPtrs);
@@ -131,93 +383,629 @@ void readDataStream(DataStream* dataStream, VulkanFFTPlan* vulkanFFT) {
 #endif
 #ifdef HAS_EXR
         case EXR: {
-            Imf::InputFile inputFile("/dev/stdin");
-            assert(inputFile.header().channels().findChannel("R") && inputFile.header().channels().findChannel("G"));
+            Imf::InputFile inputFile(dataStream->fileName);
+            assert(inputFile.header().channels().findChannel("R") && (realValues || inputFile.header().channels().findChannel("G")));
             Imath::Box2i dataWindow = inputFile.header().dataWindow();
             uint32_t width = dataWindow.max.x-dataWindow.min.x+1, height = dataWindow.max.y-dataWindow.min.y+1;
-            assert(vulkanFFTPlan.axes[0].sampleCount == width && vulkanFFTPlan.axes[1].sampleCount == height && vulkanFFTPlan.axes[2].sampleCount == 1);
-            inputFile.setFrameBuffer(frameBufferForEXR(reinterpret_cast<float*>(data), width));
+            assert(rowLength == width && vulkanFFTPlan.axes[1].sampleCount == height && vulkanFFTPlan.axes[2].sampleCount == 1 && vulkanFFTPlan.batchCount == 1);
+            inputFile.setFrameBuffer(frameBufferForEXR(reinterpret_cast<float*>(data), rowStride, realValues));
             inputFile.readPixels(dataWindow.min.y, dataWindow.max.y);
         } break;
 #endif
     }
-    freeVulkanFFTTransfer(&vulkanFFTTransfer);
 }
 
-void writeDataStream(DataStream* dataStream, VulkanFFTPlan* vulkanFFT) {
-    VulkanFFTTransfer vulkanFFTTransfer;
-    vulkanFFTTransfer.context = &context;
-    vulkanFFTTransfer.size = vulkanFFTPlan.bufferSize;
-    vulkanFFTTransfer.deviceBuffer = vulkanFFTPlan.buffer[vulkanFFTPlan.resultInSwapBuffer];
-    auto data = reinterpret_cast<std::complex<float>*>(createVulkanFFTDownload(&vulkanFFTTransfer));
+void writeTextRows(DataStream* dataStream, const float* values, size_t rowValueCount, size_t rowStride, size_t rowCount) {
+    // Blocks of rows are formatted in parallel into one text per thread, which are written in order
+    size_t blockRowCount = std::max((size_t)1, ((size_t)1 << 20) / rowValueCount);
+    std::vector<std::string> texts(hardwareThreadCount());
+    for(size_t blockBegin = 0; blockBegin < rowCount; blockBegin += blockRowCount) {
+        parallelRanges(std::min(blockRowCount, rowCount - blockBegin), 1, [&](uint32_t thread, size_t begin, size_t end) {
+            std::string* text = &texts[thread];
+            char number[128];
+            text->clear();
+            for(size_t y = blockBegin + begin; y < blockBegin + end; ++y) {
+                if(y > 0 && y % vulkanFFTPlan.axes[1].sampleCount == 0)
+                    text->push_back('\n');
+                for(size_t x = 0; x < rowValueCount; ++x) {
+                    text->append(number, formatFloat(number, sizeof(number), values[rowStride * y + x]));
+                    text->push_back(' ');
+                }
+                text->push_back('\n');
+            }
+        });
+        for(auto& text : texts) {
+            assert(fwrite(text.data(), 1, text.size(), dataStream->file) == text.size());
+            text.clear();
+        }
+    }
+}
+
+#ifdef HAS_PNG
+void writePNG(FILE* file, const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t bitDepth) {
+    png_structp pngPtr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    assert(pngPtr);
+    png_infop infoPtr = png_create_info_struct(pngPtr);
+    assert(infoPtr);
+    if(setjmp(png_jmpbuf(pngPtr))) {
+        png_destroy_write_struct(&pngPtr, &infoPtr);
+        abortWithError("Could not generate PNG output");
+    }
+    png_init_io(pngPtr, file);
+    png_set_IHDR(pngPtr, infoPtr, width, height, bitDepth, PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+    png_write_info(pngPtr, infoPtr);
+    // Like pigz: Blocks of rows are filtered (up) and deflated on all threads, all but the last stream end with a sync flush so that they can be concatenated
+    size_t rowSize = (size_t)width * bitDepth / 8, byteOrder = (bitDepth == 16) ? 1 : 0;
+    std::vector<std::vector<uint8_t>> streams(hardwareThreadCount());
+    std::vector<uLong> checksums(streams.size(), adler32(0, NULL, 0));
+    std::vector<size_t> filteredSizes(streams.size(), 0);
+    parallelRanges(height, std::max((size_t)1, ((size_t)1 << 17) / (rowSize + 1)), [&](uint32_t thread, size_t begin, size_t end) {
+        std::vector<uint8_t> filtered((end - begin) * (rowSize + 1));
+        for(size_t y = begin; y < end; ++y) {
+            uint8_t* row = &filtered[(y - begin) * (rowSize + 1)];
+            const uint8_t *current = &pixels[rowSize * y], *previous = (y > 0) ? current - rowSize : NULL;
+            row[0] = 2;
+            for(size_t x = 0; x < rowSize; ++x)
+                row[x + 1] = current[x ^ byteOrder] - ((previous) ? previous[x ^ byteOrder] : 0);
+        }
+        z_stream stream = {};
+        assert(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+        std::vector<uint8_t>* compressed = &streams[thread];
+        compressed->resize(deflateBound(&stream, filtered.size()) + 16);
+        stream.next_in = filtered.data();
+        stream.avail_in = filtered.size();
+        stream.next_out = compressed->data();
+        stream.avail_out = compressed->size();
+        assert(deflate(&stream, (end == height) ? Z_FINISH : Z_SYNC_FLUSH) == ((end == height) ? Z_STREAM_END : Z_OK) && stream.avail_in == 0);
+        compressed->resize(stream.total_out);
+        deflateEnd(&stream);
+        checksums[thread] = adler32(checksums[thread], filtered.data(), filtered.size());
+        filteredSizes[thread] = filtered.size();
+    });
+    std::vector<uint8_t> data = {0x78, 0x9C};
+    uLong checksum = adler32(0, NULL, 0);
+    for(size_t i = 0; i < streams.size(); ++i) {
+        data.insert(data.end(), streams[i].begin(), streams[i].end());
+        checksum = adler32_combine(checksum, checksums[i], filteredSizes[i]);
+    }
+    for(uint32_t i = 0; i < 4; ++i)
+        data.push_back((uint8_t)(checksum >> (24 - i * 8)));
+    // libpng only writes IEND after it compressed the image itself
+    for(size_t offset = 0; offset < data.size(); offset += PNG_UINT_31_MAX)
+        png_write_chunk(pngPtr, (png_const_bytep)"IDAT", &data[offset], std::min(data.size() - offset, (size_t)PNG_UINT_31_MAX));
+    png_write_chunk(pngPtr, (png_const_bytep)"IEND", NULL, 0);
+    png_destroy_write_struct(&pngPtr, &infoPtr);
+}
+#endif
+
+void writeFrame(DataStream* dataStream, std::complex<float>* data) {
+    bool realValues = vulkanFFTPlan.realTransform && vulkanFFTPlan.inverse;
+    uint32_t rowStride = complexRowLength(),
+             rowLength = (realValues) ? vulkanFFTPlan.axes[0].sampleCount : rowStride,
+             rowCount = vulkanFFTPlan.axes[1].sampleCount * vulkanFFTPlan.axes[2].sampleCount * vulkanFFTPlan.batchCount,
+             valueSize = (realValues) ? sizeof(float) : sizeof(std::complex<float>);
     switch(dataStream->type) {
         case RAW:
-            assert(fwrite(data, 1, (size_t)vulkanFFTPlan.bufferSize, dataStream->file) == vulkanFFTPlan.bufferSize);
+            for(uint32_t y = 0; y < rowCount; ++y)
+                assert(fwrite(&data[rowStride * y], valueSize, rowLength, dataStream->file) == rowLength);
             break;
         case ASCII:
-            for(uint32_t z = 0; z < vulkanFFTPlan.axes[2].sampleCount; ++z) {
-                uint32_t zOffset = vulkanFFTPlan.axes[0].sampleCount * vulkanFFTPlan.axes[1].sampleCount * z;
-                if(z > 0)
-                    fprintf(dataStream->file, "\n");
-                for(uint32_t y = 0; y < vulkanFFTPlan.axes[1].sampleCount; ++y) {
-                    uint32_t yzOffset = zOffset + vulkanFFTPlan.axes[0].sampleCount * y;
-                    for(uint32_t x = 0; x < vulkanFFTPlan.axes[0].sampleCount; ++x)
-                        fprintf(dataStream->file, "%.24f %.24f ", std::real(data[x + yzOffset]), std::imag(data[x + yzOffset]));
-                    fprintf(dataStream->file, "\n");
-                }
-            }
+            writeTextRows(dataStream, reinterpret_cast<const float*>(data), rowLength * valueSize / sizeof(float), rowStride * 2, rowCount);
             break;
 #ifdef HAS_PNG
         case PNG: {
-            png_structp pngPtr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-            assert(pngPtr);
-            png_infop infoPtr = png_create_info_struct(pngPtr);
-            assert(infoPtr);
-            auto rowPtrs = reinterpret_cast<png_byte**>(malloc(sizeof(png_bytep) * vulkanFFTPlan.axes[1].sampleCount));
-            if(setjmp(png_jmpbuf(pngPtr))) {
-                png_destroy_read_struct(&pngPtr, &infoPtr, (png_infopp)0);
-                free(rowPtrs);
-                abortWithError("Could not generate PNG output");
-            }
-            png_init_io(pngPtr, dataStream->file);
-            png_set_IHDR(pngPtr, infoPtr, vulkanFFTPlan.axes[0].sampleCount, vulkanFFTPlan.axes[1].sampleCount, 8, PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-            png_write_info(pngPtr, infoPtr);
+            std::vector<Pixel> pixels((size_t)rowLength * vulkanFFTPlan.axes[1].sampleCount);
             for(uint32_t y = 0; y < vulkanFFTPlan.axes[1].sampleCount; ++y) {
-                uint32_t yOffset = vulkanFFTPlan.axes[0].sampleCount * y;
-                Pixel* row = (Pixel*)&data[yOffset];
-                rowPtrs[y] = (png_byte*)row;
-                for(uint32_t x = 0; x < vulkanFFTPlan.axes[0].sampleCount; ++x)
-                    row[x] = std::real(data[x + yOffset]) * 256.0;
+                uint32_t yOffset = rowStride * y;
+                for(uint32_t x = 0; x < rowLength; ++x)
+                    pixels[(size_t)rowLength * y + x] = ((realValues) ? reinterpret_cast<float*>(&data[yOffset])[x] : std::real(data[x + yOffset])) * 256.0;
             }
-            png_set_swap(pngPtr);
-            png_write_image(pngPtr, rowPtrs);
-            png_write_end(pngPtr, NULL);
-            free(rowPtrs);
+            writePNG(dataStream->file, pixels.data(), rowLength, vulkanFFTPlan.axes[1].sampleCount, 8);
         } break;
 #endif
 #ifdef HAS_EXR
         case EXR: {
-            Imf::Header header(vulkanFFTPlan.axes[0].sampleCount, vulkanFFTPlan.axes[1].sampleCount, 1, Imath::V2f(0, 0), vulkanFFTPlan.axes[0].sampleCount, Imf::INCREASING_Y, Imf::ZIP_COMPRESSION);
+            Imf::Header header(rowLength, vulkanFFTPlan.axes[1].sampleCount, 1, Imath::V2f(0, 0), rowLength, Imf::INCREASING_Y, Imf::ZIP_COMPRESSION);
             header.channels().insert("R", Imf::Channel(Imf::FLOAT));
-            header.channels().insert("G", Imf::Channel(Imf::FLOAT));
-            Imf::OutputFile outputFile("/dev/stdout", header);
-            outputFile.setFrameBuffer(frameBufferForEXR(reinterpret_cast<float*>(data), vulkanFFTPlan.axes[0].sampleCount));
+            if(!realValues)
+                header.channels().insert("G", Imf::Channel(Imf::FLOAT));
+            Imf::OutputFile outputFile(dataStream->fileName, header);
+            outputFile.setFrameBuffer(frameBufferForEXR(reinterpret_cast<float*>(data), rowStride, realValues));
             outputFile.writePixels(vulkanFFTPlan.axes[1].sampleCount);
         } break;
 #endif
     }
+}
+
+// In half precision mode raw data is read and written as is, all other encodings are converted from and to single precision
+void readStagedFrame(DataStream* dataStream, void* staging) {
+    if(!vulkanFFTPlan.halfPrecision) {
+        readFrame(dataStream, reinterpret_cast<std::complex<float>*>(staging));
+        return;
+    }
+    auto halfs = reinterpret_cast<uint16_t*>(staging);
+    bool realValues = vulkanFFTPlan.realTransform && !vulkanFFTPlan.inverse;
+    uint32_t rowStride = complexRowLength(),
+             rowLength = (realValues) ? vulkanFFTPlan.axes[0].sampleCount : rowStride,
+             rowCount = vulkanFFTPlan.axes[1].sampleCount * vulkanFFTPlan.axes[2].sampleCount * vulkanFFTPlan.batchCount;
+    if(dataStream->type == RAW) {
+        for(uint32_t y = 0; y < rowCount; ++y)
+            assert(fread(&halfs[rowStride * 2 * y], sizeof(uint16_t) * (realValues ? 1 : 2), rowLength, dataStream->file) == rowLength);
+        return;
+    }
+    std::vector<std::complex<float>> data(rowStride * rowCount);
+    readFrame(dataStream, data.data());
+    auto values = reinterpret_cast<float*>(data.data());
+    for(size_t i = 0; i < data.size() * 2; ++i)
+        halfs[i] = floatToHalf(values[i]);
+}
+
+void writeStagedFrame(DataStream* dataStream, void* staging) {
+    if(!vulkanFFTPlan.halfPrecision) {
+        writeFrame(dataStream, reinterpret_cast<std::complex<float>*>(staging));
+        return;
+    }
+    auto halfs = reinterpret_cast<uint16_t*>(staging);
+    bool realValues = vulkanFFTPlan.realTransform && vulkanFFTPlan.inverse;
+    uint32_t rowStride = complexRowLength(),
+             rowLength = (realValues) ? vulkanFFTPlan.axes[0].sampleCount : rowStride,
+             rowCount = vulkanFFTPlan.axes[1].sampleCount * vulkanFFTPlan.axes[2].sampleCount * vulkanFFTPlan.batchCount;
+    if(dataStream->type == RAW) {
+        for(uint32_t y = 0; y < rowCount; ++y)
+            assert(fwrite(&halfs[rowStride * 2 * y], sizeof(uint16_t) * (realValues ? 1 : 2), rowLength, dataStream->file) == rowLength);
+        return;
+    }
+    std::vector<std::complex<float>> data(rowStride * rowCount);
+    auto values = reinterpret_cast<float*>(data.data());
+    for(size_t i = 0; i < data.size() * 2; ++i)
+        values[i] = halfToFloat(halfs[i]);
+    writeFrame(dataStream, data.data());
+}
+
+// Size of a frame in the layout of the buffers, which raw complex files share
+size_t frameSize() {
+    return (size_t)complexRowLength() * vulkanFFTPlan.axes[1].sampleCount * vulkanFFTPlan.axes[2].sampleCount * vulkanFFTPlan.batchCount * ((vulkanFFTPlan.halfPrecision) ? 2 : 4) * 2;
+}
+
+void openDataStream(DataStream* dataStream, bool output, bool mappable) {
+    if(!dataStream->fileName) {
+        dataStream->fileName = (output) ? "/dev/stdout" : "/dev/stdin";
+        return;
+    }
+#ifdef HAS_EXR
+    if(dataStream->type == EXR)
+        return;
+#endif
+    if(!mappable || dataStream->type != RAW) {
+        dataStream->file = fopen(dataStream->fileName, (output) ? "wb" : "rb");
+        if(!dataStream->file)
+            abortWithError("Could not open file");
+        return;
+    }
+    size_t size = frameSize();
+    int fileDescriptor = open(dataStream->fileName, (output) ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+    if(fileDescriptor < 0)
+        abortWithError("Could not open file");
+    struct stat fileStatus;
+    if(output)
+        assert(ftruncate(fileDescriptor, size) == 0);
+    else if(fstat(fileDescriptor, &fileStatus) != 0 || (size_t)fileStatus.st_size != size)
+        abortWithError("The input file does not have the size of a frame");
+    // The file is mapped into an anonymous reservation rounded up to the import alignment, so the whole range can be imported
+    size_t alignment = std::max((size_t)sysconf(_SC_PAGESIZE), mapAlignment);
+    dataStream->mapSize = (size + alignment - 1) / alignment * alignment;
+    dataStream->map = mmap(NULL, dataStream->mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(dataStream->map != MAP_FAILED);
+    assert(mmap(dataStream->map, size, PROT_READ | PROT_WRITE, ((output) ? MAP_SHARED : MAP_PRIVATE) | MAP_FIXED, fileDescriptor, 0) == dataStream->map);
+    madvise(dataStream->map, size, MADV_SEQUENTIAL);
+    close(fileDescriptor);
+}
+
+void closeDataStream(DataStream* dataStream) {
+    if(dataStream->map)
+        munmap(dataStream->map, dataStream->mapSize);
+    else if(dataStream->file != stdin && dataStream->file != stdout)
+        fclose(dataStream->file);
+}
+
+// Page faults and copies of big frames scale with the number of cores
+void parallelCopy(void* dst, const void* src, size_t size) {
+    parallelRanges(size, 1 << 22, [&](uint32_t thread, size_t begin, size_t end) {
+        memcpy((char*)dst + begin, (const char*)src + begin, end - begin);
+    });
+}
+
+// Imports a mapping with VK_EXT_external_memory_host, so the device transfers from and to the file pages directly
+bool importHostMemory(void* data, VkDeviceSize size, VkBuffer* buffer, VkDeviceMemory* deviceMemory) {
+    if(!hostMemoryImport)
+        return false;
+    PFN_vkGetMemoryHostPointerPropertiesEXT getMemoryHostPointerProperties = (PFN_vkGetMemoryHostPointerPropertiesEXT)vkGetDeviceProcAddr(context.device, "vkGetMemoryHostPointerPropertiesEXT");
+    VkMemoryHostPointerPropertiesEXT hostPointerProperties = {};
+    hostPointerProperties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+    if(!getMemoryHostPointerProperties || getMemoryHostPointerProperties(context.device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, data, &hostPointerProperties) != VK_SUCCESS)
+        return false;
+    VkExternalMemoryBufferCreateInfo externalMemoryBufferCreateInfo = {};
+    externalMemoryBufferCreateInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+    externalMemoryBufferCreateInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+    VkBufferCreateInfo bufferCreateInfo = {};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.pNext = &externalMemoryBufferCreateInfo;
+    bufferCreateInfo.size = size;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    assert(vkCreateBuffer(context.device, &bufferCreateInfo, context.allocator, buffer) == VK_SUCCESS);
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(context.device, *buffer, &memoryRequirements);
+    uint32_t memoryTypeBits = memoryRequirements.memoryTypeBits & hostPointerProperties.memoryTypeBits;
+    VkImportMemoryHostPointerInfoEXT importMemoryHostPointerInfo = {};
+    importMemoryHostPointerInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+    importMemoryHostPointerInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+    importMemoryHostPointerInfo.pHostPointer = data;
+    VkMemoryAllocateInfo memoryAllocateInfo = {};
+    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memoryAllocateInfo.pNext = &importMemoryHostPointerInfo;
+    memoryAllocateInfo.allocationSize = size;
+    for(memoryAllocateInfo.memoryTypeIndex = 0; memoryAllocateInfo.memoryTypeIndex < 32; ++memoryAllocateInfo.memoryTypeIndex)
+        if(memoryTypeBits & (1U << memoryAllocateInfo.memoryTypeIndex))
+            break;
+    if(memoryTypeBits == 0 || vkAllocateMemory(context.device, &memoryAllocateInfo, context.allocator, deviceMemory) != VK_SUCCESS) {
+        vkDestroyBuffer(context.device, *buffer, context.allocator);
+        return false;
+    }
+    assert(vkBindBufferMemory(context.device, *buffer, *deviceMemory, 0) == VK_SUCCESS);
+    return true;
+}
+
+void recordMappedCopy(VkCommandBuffer commandBuffer, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkBuffer srcBuffer, VkDeviceSize srcOffset, VkDeviceSize size) {
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+    VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = srcOffset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+}
+
+// Without an import the frame is copied through two staging chunks,
+// so the host copy of one chunk overlaps with the device transfer of the other
+typedef struct {
+    VkBuffer buffer;
+    VkDeviceMemory deviceMemory;
+    void* data;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+} StagingChunk;
+
+void transferMappedDataStream(DataStream* dataStream, VkBuffer deviceBuffer, bool download) {
+    size_t size = frameSize();
+    VkBuffer hostBuffer;
+    VkDeviceMemory hostDeviceMemory;
+    if(importHostMemory(dataStream->map, dataStream->mapSize, &hostBuffer, &hostDeviceMemory)) {
+        VkCommandBuffer commandBuffer = createCommandBuffer(&context, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        if(download)
+            recordMappedCopy(commandBuffer, hostBuffer, 0, deviceBuffer, 0, size);
+        else
+            recordMappedCopy(commandBuffer, deviceBuffer, 0, hostBuffer, 0, size);
+        vkEndCommandBuffer(commandBuffer);
+        executeCommandBuffer(&context, commandBuffer);
+        vkDestroyBuffer(context.device, hostBuffer, context.allocator);
+        vkFreeMemory(context.device, hostDeviceMemory, context.allocator);
+        return;
+    }
+    const size_t chunkSize = std::min(size, (size_t)64 << 20);
+    size_t chunkCount = (size + chunkSize - 1) / chunkSize;
+    StagingChunk chunks[2];
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    for(uint32_t i = 0; i < COUNT_OF(chunks); ++i) {
+        createBuffer(&context, &chunks[i].buffer, &chunks[i].deviceMemory, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, chunkSize);
+        vkMapMemory(context.device, chunks[i].deviceMemory, 0, chunkSize, 0, &chunks[i].data);
+        assert(vkCreateFence(context.device, &fenceCreateInfo, context.allocator, &chunks[i].fence) == VK_SUCCESS);
+    }
+    auto chunkBytes = [&](size_t chunkIndex) {
+        return std::min(chunkSize, size - chunkIndex * chunkSize);
+    };
+    auto submitChunk = [&](size_t chunkIndex) {
+        StagingChunk* chunk = &chunks[chunkIndex % 2];
+        chunk->commandBuffer = createCommandBuffer(&context, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        if(download)
+            recordMappedCopy(chunk->commandBuffer, chunk->buffer, 0, deviceBuffer, chunkIndex * chunkSize, chunkBytes(chunkIndex));
+        else
+            recordMappedCopy(chunk->commandBuffer, deviceBuffer, chunkIndex * chunkSize, chunk->buffer, 0, chunkBytes(chunkIndex));
+        vkEndCommandBuffer(chunk->commandBuffer);
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &chunk->commandBuffer;
+        assert(vkQueueSubmit(context.queue, 1, &submitInfo, chunk->fence) == VK_SUCCESS);
+    };
+    auto waitChunk = [&](size_t chunkIndex) {
+        StagingChunk* chunk = &chunks[chunkIndex % 2];
+        assert(vkWaitForFences(context.device, 1, &chunk->fence, VK_TRUE, 100000000000) == VK_SUCCESS);
+        assert(vkResetFences(context.device, 1, &chunk->fence) == VK_SUCCESS);
+        vkFreeCommandBuffers(context.device, context.commandPool, 1, &chunk->commandBuffer);
+    };
+    char* data = (char*)dataStream->map;
+    if(download) {
+        for(size_t i = 0; i < std::min(chunkCount, (size_t)2); ++i)
+            submitChunk(i);
+        for(size_t i = 0; i < chunkCount; ++i) {
+            waitChunk(i);
+            parallelCopy(data + i * chunkSize, chunks[i % 2].data, chunkBytes(i));
+            if(i + 2 < chunkCount)
+                submitChunk(i + 2);
+        }
+    } else {
+        for(size_t i = 0; i < chunkCount; ++i) {
+            if(i >= 2)
+                waitChunk(i - 2);
+            parallelCopy(chunks[i % 2].data, data + i * chunkSize, chunkBytes(i));
+            submitChunk(i);
+        }
+        for(size_t i = (chunkCount > 2) ? chunkCount - 2 : 0; i < chunkCount; ++i)
+            waitChunk(i);
+    }
+    for(uint32_t i = 0; i < COUNT_OF(chunks); ++i) {
+        vkDestroyFence(context.device, chunks[i].fence, context.allocator);
+        vkUnmapMemory(context.device, chunks[i].deviceMemory);
+        vkDestroyBuffer(context.device, chunks[i].buffer, context.allocator);
+        vkFreeMemory(context.device, chunks[i].deviceMemory, context.allocator);
+    }
+}
+
+void readDataStream(DataStream* dataStream, VulkanFFTPlan* vulkanFFT) {
+    if(dataStream->map) {
+        transferMappedDataStream(dataStream, vulkanFFTPlan.buffer[0], false);
+        return;
+    }
+    VulkanFFTTransfer vulkanFFTTransfer;
+    vulkanFFTTransfer.context = &context;
+    vulkanFFTTransfer.size = vulkanFFTPlan.bufferSize;
+    vulkanFFTTransfer.deviceBuffer = vulkanFFTPlan.buffer[0];
+    readStagedFrame(dataStream, createVulkanFFTUpload(&vulkanFFTTransfer));
     freeVulkanFFTTransfer(&vulkanFFTTransfer);
 }
 
+void writeDataStream(DataStream* dataStream, VulkanFFTPlan* vulkanFFT) {
+    if(dataStream->map) {
+        transferMappedDataStream(dataStream, vulkanFFTPlan.buffer[vulkanFFTPlan.resultInSwapBuffer], true);
+        return;
+    }
+    VulkanFFTTransfer vulkanFFTTransfer;
+    vulkanFFTTransfer.context = &context;
+    vulkanFFTTransfer.size = vulkanFFTPlan.bufferSize;
+    vulkanFFTTransfer.deviceBuffer = vulkanFFTPlan.buffer[vulkanFFTPlan.resultInSwapBuffer];
+    writeStagedFrame(dataStream, createVulkanFFTDownload(&vulkanFFTTransfer));
+    freeVulkanFFTTransfer(&vulkanFFTTransfer);
+}
+
+void writeImage(DataStream* dataStream, const void* image, uint32_t width, uint32_t height, uint32_t bitDepth) {
+    switch(dataStream->type) {
+        case RAW: {
+            size_t size = (size_t)width * height * bitDepth / 8;
+            assert(fwrite(image, 1, size, dataStream->file) == size);
+        } break;
+        case ASCII:
+            writeTextRows(dataStream, reinterpret_cast<const float*>(image), width, width, height);
+            break;
+#ifdef HAS_PNG
+        case PNG:
+            writePNG(dataStream->file, reinterpret_cast<const uint8_t*>(image), width, height, bitDepth);
+            break;
+#endif
+#ifdef HAS_EXR
+        case EXR: {
+            Imf::Header header(width, height, 1, Imath::V2f(0, 0), width, Imf::INCREASING_Y, Imf::ZIP_COMPRESSION);
+            header.channels().insert("R", Imf::Channel(Imf::FLOAT));
+            Imf::FrameBuffer frameBuffer;
+            frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, (char*)image, sizeof(float), sizeof(float) * width));
+            Imf::OutputFile outputFile(dataStream->fileName, header);
+            outputFile.setFrameBuffer(frameBuffer);
+            outputFile.writePixels(height);
+        } break;
+#endif
+    }
+}
+
+void writeVisualization(DataStream* dataStream) {
+    // Only the quantized image is downloaded
+    VulkanFFTTransfer vulkanFFTTransfer;
+    vulkanFFTTransfer.context = &context;
+    vulkanFFTTransfer.size = visualization.imageSize;
+    vulkanFFTTransfer.deviceBuffer = visualization.image;
+    writeImage(dataStream, createVulkanFFTDownload(&vulkanFFTTransfer), visualization.width, visualization.height, visualization.bitDepth);
+    freeVulkanFFTTransfer(&vulkanFFTTransfer);
+}
+
+void writeProfile(const char* fileName, VulkanFFTPlan* plan) {
+    FILE* file = fopen(fileName, "w");
+    if(!file)
+        abortWithError("Could not open profile file");
+    if(!queryVulkanFFTProfile(plan))
+        abortWithError("Profile is not available");
+    fprintf(file, "{\n  \"axes\": [");
+    bool firstAxis = true;
+    for(uint32_t i = 0; i < COUNT_OF(plan->axes); ++i) {
+        auto axis = &plan->axes[i];
+        if(axis->passCount == 0)
+            continue;
+        fprintf(file, "%s\n    {\"axis\": %d, \"sampleCount\": %d, \"timeNs\": %.1f, \"gflops\": %.3f, \"gbps\": %.3f, \"passes\": [",
+                (firstAxis) ? "" : ",", i, axis->sampleCount, axis->profile.time, axis->profile.gigaFlopsPerSecond, axis->profile.gigaBytesPerSecond);
+        firstAxis = false;
+        for(uint32_t j = 0; j < axis->passCount; ++j) {
+            auto profile = &axis->passes[j].profile;
+            fprintf(file, "%s\n      {\"pipeline\": %d, \"timeNs\": %.1f, \"gflops\": %.3f, \"gbps\": %.3f}",
+                    (j == 0) ? "" : ",", axis->passes[j].pipelineIndex, profile->time, profile->gigaFlopsPerSecond, profile->gigaBytesPerSecond);
+        }
+        fprintf(file, "\n    ]}");
+    }
+    fprintf(file, "\n  ]\n}\n");
+    fclose(file);
+}
+
+// Every slot of the stream has its own plan with its device buffers, staging buffers and fence. A submission uploads and transforms the frame of its slot
+// and downloads the result of the previous slot, so parsing and writing frames, uploads and transforms overlap with each other.
+typedef struct {
+    VulkanFFTPlan plan;
+    VkBuffer uploadBuffer, downloadBuffer;
+    VkDeviceMemory uploadDeviceMemory, downloadDeviceMemory;
+    void* uploadData;
+    void* downloadData;
+    VkCommandBuffer commandBuffer, downloadCommandBuffer;
+    VkFence fence;
+    bool pending;
+    // Frame whose result the pending submission downloads, UINT32_MAX for none
+    uint32_t frame;
+} StreamSlot;
+
+StreamSlot* createStreamSlots(uint32_t slotCount) {
+    StreamSlot* slots = new StreamSlot[slotCount];
+    for(uint32_t i = 0; i < slotCount; ++i) {
+        StreamSlot* slot = &slots[i];
+        slot->plan = vulkanFFTPlan;
+        if(!createVulkanFFT(&slot->plan))
+            abortWithError("In place transforms need rows which fit into shared memory and no Bluestein");
+        createBuffer(&context, &slot->uploadBuffer, &slot->uploadDeviceMemory, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, slot->plan.bufferSize);
+        createBuffer(&context, &slot->downloadBuffer, &slot->downloadDeviceMemory, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, slot->plan.bufferSize);
+        vkMapMemory(context.device, slot->uploadDeviceMemory, 0, slot->plan.bufferSize, 0, &slot->uploadData);
+        vkMapMemory(context.device, slot->downloadDeviceMemory, 0, slot->plan.bufferSize, 0, &slot->downloadData);
+        VkFenceCreateInfo fenceCreateInfo = {};
+        fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        assert(vkCreateFence(context.device, &fenceCreateInfo, context.allocator, &slot->fence) == VK_SUCCESS);
+        slot->pending = false;
+    }
+    // The command buffers are recorded once and resubmitted for every frame of the slot
+    for(uint32_t i = 0; i < slotCount; ++i) {
+        VulkanFFTPlan* previousPlan = &slots[(i + slotCount - 1) % slotCount].plan;
+        slots[i].commandBuffer = recordVulkanFFTSlot(&slots[i].plan, slots[i].uploadBuffer, previousPlan, slots[i].downloadBuffer, true);
+        slots[i].downloadCommandBuffer = recordVulkanFFTSlot(&slots[i].plan, slots[i].uploadBuffer, previousPlan, slots[i].downloadBuffer, false);
+    }
+    return slots;
+}
+
+void finishStreamSlot(StreamSlot* slot) {
+    if(!slot->pending)
+        return;
+    assert(vkWaitForFences(context.device, 1, &slot->fence, VK_TRUE, 100000000000) == VK_SUCCESS);
+    assert(vkResetFences(context.device, 1, &slot->fence) == VK_SUCCESS);
+    if(slot->frame != UINT32_MAX) {
+        if(outputStream.type == ASCII && slot->frame > 0)
+            fprintf(outputStream.file, "\n");
+        writeStagedFrame(&outputStream, slot->downloadData);
+    }
+    slot->pending = false;
+}
+
+void destroyStreamSlots(StreamSlot* slots, uint32_t slotCount) {
+    for(uint32_t i = 0; i < slotCount; ++i) {
+        StreamSlot* slot = &slots[i];
+        VkCommandBuffer commandBuffers[2] = {slot->commandBuffer, slot->downloadCommandBuffer};
+        vkFreeCommandBuffers(context.device, context.commandPool, COUNT_OF(commandBuffers), commandBuffers);
+        vkDestroyFence(context.device, slot->fence, context.allocator);
+        vkUnmapMemory(context.device, slot->uploadDeviceMemory);
+        vkUnmapMemory(context.device, slot->downloadDeviceMemory);
+        vkDestroyBuffer(context.device, slot->uploadBuffer, context.allocator);
+        vkDestroyBuffer(context.device, slot->downloadBuffer, context.allocator);
+        vkFreeMemory(context.device, slot->uploadDeviceMemory, context.allocator);
+        vkFreeMemory(context.device, slot->downloadDeviceMemory, context.allocator);
+        destroyVulkanFFT(&slot->plan);
+    }
+    delete[] slots;
+}
+
+uint32_t streamFrames(StreamSlot* slots, uint32_t slotCount) {
+    // The result of a frame arrives with the submission of the next slot, one more submission only downloads the last one.
+    // Slots are finished in submission order, so the frames are written in order.
+    uint32_t frameCount = 0;
+    for(bool nextFrame = hasNextFrame(&inputStream); nextFrame || frameCount > 0; ++frameCount) {
+        StreamSlot* slot = &slots[frameCount % slotCount];
+        finishStreamSlot(slot);
+        if(nextFrame)
+            readStagedFrame(&inputStream, slot->uploadData);
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = (nextFrame) ? &slot->commandBuffer : &slot->downloadCommandBuffer;
+        assert(vkQueueSubmit(context.queue, 1, &submitInfo, slot->fence) == VK_SUCCESS);
+        slot->frame = (frameCount > 0) ? frameCount - 1 : UINT32_MAX;
+        slot->pending = true;
+        if(!nextFrame)
+            break;
+        nextFrame = hasNextFrame(&inputStream);
+    }
+    // Drain the remaining submissions in submission order
+    for(uint32_t i = 1; i <= slotCount; ++i)
+        finishStreamSlot(&slots[(frameCount + i) % slotCount]);
+    return frameCount;
+}
+
+// The CPU engine reads, transforms and writes one frame after another
+void transformFramesOnCPU(bool stream, bool measureTime) {
+#ifdef HAS_EXR
+    if(stream && (inputStream.type == EXR || outputStream.type == EXR))
+        abortWithError("EXR can not be streamed");
+#endif
+    auto timeA = std::chrono::steady_clock::now();
+    createVulkanFFT(&vulkanFFTPlan);
+    std::vector<std::complex<float>> data(vulkanFFTPlan.bufferSize / sizeof(std::complex<float>));
+    auto timeB = std::chrono::steady_clock::now();
+    double inputTime = 0.0, computationTime = 0.0, outputTime = 0.0;
+    uint32_t frameCount = 0;
+    for(; (stream) ? hasNextFrame(&inputStream) : frameCount == 0; ++frameCount) {
+        auto timeC = std::chrono::steady_clock::now();
+        if(!inputStream.map)
+            readFrame(&inputStream, data.data());
+        auto timeD = std::chrono::steady_clock::now();
+        transformVulkanFFTOnHost(&vulkanFFTPlan, (inputStream.map) ? inputStream.map : data.data(), (outputStream.map) ? outputStream.map : data.data());
+        auto timeE = std::chrono::steady_clock::now();
+        if(outputStream.type == ASCII && frameCount > 0)
+            fprintf(outputStream.file, "\n");
+        if(!outputStream.map)
+            writeFrame(&outputStream, data.data());
+        auto timeF = std::chrono::steady_clock::now();
+        inputTime += std::chrono::duration_cast<std::chrono::microseconds>(timeD-timeC).count()*0.001;
+        computationTime += std::chrono::duration_cast<std::chrono::microseconds>(timeE-timeD).count()*0.001;
+        outputTime += std::chrono::duration_cast<std::chrono::microseconds>(timeF-timeE).count()*0.001;
+    }
+    auto timeG = std::chrono::steady_clock::now();
+    destroyVulkanFFT(&vulkanFFTPlan);
+    auto timeH = std::chrono::steady_clock::now();
+    if(measureTime) {
+        fprintf(stderr, "Setup: %.3f ms\n", std::chrono::duration_cast<std::chrono::microseconds>(timeB-timeA).count()*0.001);
+        fprintf(stderr, "Input: %.3f ms\n", inputTime);
+        fprintf(stderr, "Computation (CPU): %.3f ms\n", computationTime);
+        fprintf(stderr, "Output: %.3f ms\n", outputTime);
+        if(stream) {
+            double streamTime = std::chrono::duration_cast<std::chrono::microseconds>(timeG-timeB).count()*0.001;
+            fprintf(stderr, "Stream: %d frames in %.3f ms (%.3f frames/s)\n", frameCount, streamTime, frameCount * 1000.0 / streamTime);
+        }
+        fprintf(stderr, "Teardown: %.3f ms\n", std::chrono::duration_cast<std::chrono::microseconds>(timeH-timeG).count()*0.001);
+    }
+}
+
 int main(int argc, const char** argv) {
-    uint32_t deviceIndex = 0;
+    std::vector<uint32_t> deviceIndices;
+    std::vector<VulkanFFTContext> additionalContexts;
+    std::vector<VulkanFFTContext*> deviceContexts;
     vulkanFFTPlan.axes[0].sampleCount = 1;
     vulkanFFTPlan.axes[1].sampleCount = 1;
     vulkanFFTPlan.axes[2].sampleCount = 1;
+    vulkanFFTPlan.batchCount = 1;
     inputStream.file = stdin;
     outputStream.file = stdout;
+    uint32_t streamSlotCount = 0;
+    unsigned long long workingSetSize = 0;
+    uint32_t instanceVersion = VK_API_VERSION_1_0;
+    const char* profileFileName = NULL;
     bool listDevices = false,
-         measureTime = false;
+         measureTime = false,
+         hostFallback = false;
     for(int i = 1; i < argc; ++i) {
         if(strcmp(argv[i], "-x") == 0) {
             assert(++i < argc);
@@ -228,8 +1016,47 @@ int main(int argc, const char** argv) {
         } else if(strcmp(argv[i], "-z") == 0) {
             assert(++i < argc);
             sscanf(argv[i], "%d", &vulkanFFTPlan.axes[2].sampleCount);
+        } else if(strcmp(argv[i], "--batch") == 0) {
+            assert(++i < argc);
+            sscanf(argv[i], "%d", &vulkanFFTPlan.batchCount);
+        } else if(strcmp(argv[i], "--stream") == 0) {
+            assert(++i < argc);
+            sscanf(argv[i], "%d", &streamSlotCount);
+            assert(streamSlotCount > 0);
+            // A slot downloads the result of the previous slot, so one frame in flight still takes two slots
+            if(streamSlotCount < 2)
+                streamSlotCount = 2;
+        } else if(strcmp(argv[i], "--working-set") == 0) {
+            assert(++i < argc);
+            sscanf(argv[i], "%llu", &workingSetSize);
+            assert(workingSetSize > 0);
         } else if(strcmp(argv[i], "--inverse") == 0)
             vulkanFFTPlan.inverse = true;
+        else if(strcmp(argv[i], "--half") == 0)
+            vulkanFFTPlan.halfPrecision = true;
+        else if(strcmp(argv[i], "--real") == 0)
+            vulkanFFTPlan.realTransform = true;
+        else if(strcmp(argv[i], "--in-place") == 0)
+            vulkanFFTPlan.inPlace = true;
+        else if(strcmp(argv[i], "--shortest") == 0)
+            shortestNumbers = true;
+        else if(strcmp(argv[i], "--coalesced") == 0)
+            vulkanFFTPlan.coalesced = true;
+        else if(strcmp(argv[i], "--compute-twiddle-factors") == 0)
+            vulkanFFTPlan.computeTwiddleFactors = true;
+        else if(strcmp(argv[i], "--pipeline-cache") == 0) {
+            assert(++i < argc);
+            context.pipelineCacheFileName = argv[i];
+        } else if(strcmp(argv[i], "--wisdom") == 0) {
+            assert(++i < argc);
+            context.wisdomFileName = argv[i];
+        } else if(strcmp(argv[i], "--measure") == 0)
+            vulkanFFTPlan.measure = true;
+        else if(strcmp(argv[i], "--profile") == 0) {
+            assert(++i < argc);
+            profileFileName = argv[i];
+            vulkanFFTPlan.profile = true;
+        }
         else if(strcmp(argv[i], "--input") == 0 || strcmp(argv[i], "--output") == 0) {
             DataStream* dataStream = (strcmp(argv[i], "--input") == 0) ? &inputStream : &outputStream;
             assert(++i < argc);
@@ -245,9 +1072,33 @@ int main(int argc, const char** argv) {
             else if(strcmp(argv[i], "exr") == 0)
                 dataStream->type = EXR;
 #endif
+        } else if(strcmp(argv[i], "--visualize") == 0) {
+            assert(++i < argc);
+            const char* modes[] = {"real", "magnitude", "log-magnitude", "phase"};
+            for(visualization.mode = 0; visualization.mode < COUNT_OF(modes) && strcmp(argv[i], modes[visualization.mode]) != 0; ++visualization.mode);
+            if(visualization.mode == COUNT_OF(modes))
+                abortWithError("Unknown visualization mode");
+            visualizeOutput = true;
+        } else if(strcmp(argv[i], "--shift") == 0)
+            visualization.shift = true;
+        else if(strcmp(argv[i], "--bit-depth") == 0) {
+            assert(++i < argc);
+            sscanf(argv[i], "%d", &visualization.bitDepth);
+            if(visualization.bitDepth != 8 && visualization.bitDepth != 16)
+                abortWithError("Only bit depths of 8 and 16 are supported");
+        } else if(strcmp(argv[i], "--input-file") == 0 || strcmp(argv[i], "--output-file") == 0) {
+            DataStream* dataStream = (strcmp(argv[i], "--input-file") == 0) ? &inputStream : &outputStream;
+            assert(++i < argc);
+            dataStream->fileName = argv[i];
         } else if(strcmp(argv[i], "--device") == 0) {
             assert(++i < argc);
+            if(strcmp(argv[i], "cpu") == 0) {
+                vulkanFFTPlan.onHost = true;
+                continue;
+            }
+            uint32_t deviceIndex = 0;
             sscanf(argv[i], "%d", &deviceIndex);
+            deviceIndices.push_back(deviceIndex);
         } else if(strcmp(argv[i], "--list-devices") == 0)
             listDevices = true;
          else if(strcmp(argv[i], "--measure-time") == 0)
@@ -256,7 +1107,27 @@ int main(int argc, const char** argv) {
             fprintf(stderr, "Unrecognized option %s\n", argv[i]);
     }
 
+    if(visualizeOutput) {
+        // The image is computed on a single device, ASCII and EXR keep the normalized floats
+        if(streamSlotCount > 0 || workingSetSize > 0 || deviceIndices.size() > 1)
+            abortWithError("Visualization only supports single frames on a single device");
+        if(outputStream.type == ASCII)
+            visualization.bitDepth = 32;
+#ifdef HAS_EXR
+        if(outputStream.type == EXR)
+            visualization.bitDepth = 32;
+#endif
+    }
+
     {
+        // Without a device given, small transforms and machines without any device use the CPU engine
+        bool hostCapable = !vulkanFFTPlan.halfPrecision && !vulkanFFTPlan.profile && !visualizeOutput && workingSetSize == 0;
+        if(vulkanFFTPlan.onHost && (!hostCapable || !deviceIndices.empty()))
+            abortWithError("The CPU can not be combined with devices, half precision, profiling, visualization or out of core transforms");
+        hostFallback = hostCapable && deviceIndices.empty() && !listDevices;
+    }
+
+    if(!vulkanFFTPlan.onHost) {
         const char* requiredLayers[] = {
             #ifndef NDEBUG
             "VK_LAYER_KHRONOS_validation"
@@ -303,19 +1174,33 @@ int main(int argc, const char** argv) {
             }
         }
         delete[] extensions;
+        // Importing host memory needs Vulkan 1.1, everything else runs on 1.0
+        VkApplicationInfo applicationInfo = {};
+        applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        PFN_vkEnumerateInstanceVersion enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(VK_NULL_HANDLE, "vkEnumerateInstanceVersion");
+        if(enumerateInstanceVersion)
+            enumerateInstanceVersion(&instanceVersion);
+        applicationInfo.apiVersion = instanceVersion;
         VkInstanceCreateInfo instanceCreateInfo = {};
+        instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        instanceCreateInfo.pApplicationInfo = &applicationInfo;
         instanceCreateInfo.enabledLayerCount = COUNT_OF(requiredLayers);
         instanceCreateInfo.ppEnabledLayerNames = requiredLayers;
         instanceCreateInfo.enabledExtensionCount = COUNT_OF(requiredExtensions);
         instanceCreateInfo.ppEnabledExtensionNames = requiredExtensions;
         VkResult result = vkCreateInstance(&instanceCreateInfo, context.allocator, &instance);
-        if(result == VK_ERROR_INCOMPATIBLE_DRIVER)
+        if(result == VK_ERROR_INCOMPATIBLE_DRIVER && hostFallback) {
+            fprintf(stderr, "No driver found, transforming on the CPU\n");
+            vulkanFFTPlan.onHost = true;
+            instance = VK_NULL_HANDLE;
+        } else if(result == VK_ERROR_INCOMPATIBLE_DRIVER)
             abortWithError("No driver found, could not create instance: Is VK_ICD_FILENAMES set correctly?");
-        assert(result == VK_SUCCESS);
+        else
+            assert(result == VK_SUCCESS);
     }
 
     #ifndef NDEBUG
-    {
+    if(instance) {
         VkDebugUtilsMessengerCreateInfoEXT debugUtilsMessengerCreateInfo = {};
         debugUtilsMessengerCreateInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
         debugUtilsMessengerCreateInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
@@ -328,13 +1213,25 @@ int main(int argc, const char** argv) {
     }
     #endif
 
-    {
+    if(instance && hostFallback) {
+        uint32_t physicalDeviceCount = 0;
+        vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, NULL);
+        if(physicalDeviceCount == 0) {
+            fprintf(stderr, "No devices found, transforming on the CPU\n");
+            vulkanFFTPlan.onHost = true;
+        }
+    }
+
+    if(!vulkanFFTPlan.onHost) {
         uint32_t physicalDeviceCount = 0;
         vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, NULL);
         if(physicalDeviceCount == 0)
             abortWithError("No devices found");
-        if(deviceIndex >= physicalDeviceCount)
-            abortWithError("Device index too high");
+        if(deviceIndices.empty())
+            deviceIndices.push_back(0);
+        for(uint32_t deviceIndex : deviceIndices)
+            if(deviceIndex >= physicalDeviceCount)
+                abortWithError("Device index too high");
         VkPhysicalDevice* physicalDevices = new VkPhysicalDevice[physicalDeviceCount];
         vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices);
         for(uint32_t i = 0; i < physicalDeviceCount; ++i) {
@@ -350,7 +1247,12 @@ int main(int argc, const char** argv) {
             vkGetPhysicalDeviceQueueFamilyProperties(physicalDevices[i], &queueFamilyCount, queueFamilies);
             delete[] queueFamilies;
         }
-        context.physicalDevice = physicalDevices[deviceIndex];
+        // Every device given has its own context, the same physical device can be given multiple times
+        additionalContexts.resize(deviceIndices.size() - 1, context);
+        for(uint32_t i = 0; i < deviceIndices.size(); ++i)
+            deviceContexts.push_back((i == 0) ? &context : &additionalContexts[i - 1]);
+        for(uint32_t i = 0; i < deviceContexts.size(); ++i)
+            deviceContexts[i]->physicalDevice = physicalDevices[deviceIndices[i]];
         delete[] physicalDevices;
 
         VkDeviceQueueCreateInfo deviceQueueCreateInfo = {};
@@ -367,21 +1269,146 @@ int main(int argc, const char** argv) {
         deviceCreateInfo.queueCreateInfoCount = 1;
         deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
         deviceCreateInfo.enabledLayerCount = 0;
-        assert(vkCreateDevice(context.physicalDevice, &deviceCreateInfo, context.allocator, &context.device) == VK_SUCCESS);
-        vkGetDeviceQueue(context.device, deviceQueueCreateInfo.queueFamilyIndex, 0, &context.queue);
-
         VkCommandPoolCreateInfo commandPoolCreateInfo = {};
         commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
         commandPoolCreateInfo.queueFamilyIndex = 0;
-        assert(vkCreateCommandPool(context.device, &commandPoolCreateInfo, context.allocator, &context.commandPool) == VK_SUCCESS);
+        // Raw files are imported as staging buffers if the first device supports VK_EXT_external_memory_host
+        const char* importExtensions[] = {VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME};
+        {
+            VkPhysicalDeviceProperties deviceProperties;
+            vkGetPhysicalDeviceProperties(context.physicalDevice, &deviceProperties);
+            uint32_t extensionCount = 0;
+            vkEnumerateDeviceExtensionProperties(context.physicalDevice, NULL, &extensionCount, NULL);
+            VkExtensionProperties* extensions = new VkExtensionProperties[extensionCount];
+            vkEnumerateDeviceExtensionProperties(context.physicalDevice, NULL, &extensionCount, extensions);
+            for(uint32_t i = 0; i < extensionCount; ++i)
+                if(strcmp(importExtensions[0], extensions[i].extensionName) == 0)
+                    hostMemoryImport = deviceProperties.apiVersion >= VK_API_VERSION_1_1 && instanceVersion >= VK_API_VERSION_1_1;
+            delete[] extensions;
+        }
+        if(hostMemoryImport) {
+            VkPhysicalDeviceExternalMemoryHostPropertiesEXT externalMemoryHostProperties = {};
+            externalMemoryHostProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+            VkPhysicalDeviceProperties2 deviceProperties = {};
+            deviceProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            deviceProperties.pNext = &externalMemoryHostProperties;
+            vkGetPhysicalDeviceProperties2(context.physicalDevice, &deviceProperties);
+            mapAlignment = externalMemoryHostProperties.minImportedHostPointerAlignment;
+        }
+        for(VulkanFFTContext* deviceContext : deviceContexts) {
+            deviceCreateInfo.enabledExtensionCount = (hostMemoryImport && deviceContext == &context) ? COUNT_OF(importExtensions) : 0;
+            deviceCreateInfo.ppEnabledExtensionNames = importExtensions;
+            assert(vkCreateDevice(deviceContext->physicalDevice, &deviceCreateInfo, deviceContext->allocator, &deviceContext->device) == VK_SUCCESS);
+            vkGetDeviceQueue(deviceContext->device, deviceQueueCreateInfo.queueFamilyIndex, 0, &deviceContext->queue);
+            assert(vkCreateCommandPool(deviceContext->device, &commandPoolCreateInfo, deviceContext->allocator, &deviceContext->commandPool) == VK_SUCCESS);
+        }
+    }
+
+    // Without a device given, transforms which take less time on the CPU than a submission to the device (both measured on the first call of preferVulkanFFTOnHost) use the CPU engine
+    bool contextInitialized = false;
+    if(hostFallback && !vulkanFFTPlan.onHost && !vulkanFFTPlan.measure) {
+        initVulkanFFTContext(&context);
+        contextInitialized = !preferVulkanFFTOnHost(&vulkanFFTPlan);
+        if(!contextInitialized) {
+            freeVulkanFFTContext(&context);
+            vulkanFFTPlan.onHost = true;
+        }
     }
 
+    // Only raw complex frames match the layout of the buffers, streams and real data are read and written through the files
+    bool mappable = streamSlotCount == 0 && !vulkanFFTPlan.realTransform;
     if(!listDevices) {
+        openDataStream(&inputStream, false, mappable);
+        openDataStream(&outputStream, true, mappable && !visualizeOutput);
+    }
+#ifdef HAS_EXR
+    Imf::setGlobalThreadCount(hardwareThreadCount());
+#endif
+
+    if(!listDevices && vulkanFFTPlan.onHost)
+        transformFramesOnCPU(streamSlotCount > 0, measureTime);
+    else if(!listDevices && streamSlotCount > 0) {
+#ifdef HAS_EXR
+        if(inputStream.type == EXR || outputStream.type == EXR)
+            abortWithError("EXR can not be streamed");
+#endif
         auto timeA = std::chrono::steady_clock::now();
-        initVulkanFFTContext(&context);
-        createVulkanFFT(&vulkanFFTPlan);
+        if(!contextInitialized)
+            initVulkanFFTContext(&context);
+        StreamSlot* slots = createStreamSlots(streamSlotCount);
+        if(vulkanFFTPlan.measure && context.wisdomFileName)
+            saveVulkanFFTWisdom(&context);
+        auto timeB = std::chrono::steady_clock::now();
+        uint32_t frameCount = streamFrames(slots, streamSlotCount);
+        auto timeC = std::chrono::steady_clock::now();
+        if(profileFileName && frameCount > 0)
+            writeProfile(profileFileName, &slots[(frameCount - 1) % streamSlotCount].plan);
+        destroyStreamSlots(slots, streamSlotCount);
+        if(context.pipelineCacheFileName)
+            saveVulkanFFTPipelineCache(&context);
+        freeVulkanFFTContext(&context);
+        auto timeD = std::chrono::steady_clock::now();
+        if(measureTime) {
+            double streamTime = std::chrono::duration_cast<std::chrono::microseconds>(timeC-timeB).count()*0.001;
+            fprintf(stderr, "Setup: %.3f ms\n", std::chrono::duration_cast<std::chrono::microseconds>(timeB-timeA).count()*0.001);
+            fprintf(stderr, "Stream: %d frames in %.3f ms (%.3f frames/s)\n", frameCount, streamTime, frameCount * 1000.0 / streamTime);
+            fprintf(stderr, "Teardown: %.3f ms\n", std::chrono::duration_cast<std::chrono::microseconds>(timeD-timeC).count()*0.001);
+        }
+    } else if(!listDevices && (workingSetSize > 0 || deviceContexts.size() > 1)) {
+        if(vulkanFFTPlan.realTransform || vulkanFFTPlan.halfPrecision)
+            abortWithError("Out of core and multi device transforms only support complex single precision data");
+        auto timeA = std::chrono::steady_clock::now();
+        std::vector<VulkanFFTOutOfCore> outOfCores(deviceContexts.size());
+        for(uint32_t i = 0; i < deviceContexts.size(); ++i) {
+            initVulkanFFTContext(deviceContexts[i]);
+            outOfCores[i] = {};
+            outOfCores[i].plan = vulkanFFTPlan;
+            outOfCores[i].plan.context = deviceContexts[i];
+            outOfCores[i].workingSetSize = workingSetSize;
+            createVulkanFFTOutOfCore(&outOfCores[i]);
+        }
+        // The whole data set stays in host memory (or mapped files), only chunks of it are transformed on the devices
+        size_t sampleCount = (size_t)vulkanFFTPlan.axes[0].sampleCount * vulkanFFTPlan.axes[1].sampleCount * vulkanFFTPlan.axes[2].sampleCount * outOfCores[0].plan.batchCount;
+        std::vector<std::complex<float>> input((inputStream.map) ? 0 : sampleCount), output((outputStream.map) ? 0 : sampleCount);
+        auto timeB = std::chrono::steady_clock::now();
+        if(!inputStream.map)
+            readFrame(&inputStream, input.data());
+        auto timeC = std::chrono::steady_clock::now();
+        transformVulkanFFTMultiDevice(outOfCores.data(), outOfCores.size(), (inputStream.map) ? inputStream.map : input.data(), (outputStream.map) ? outputStream.map : output.data());
+        auto timeD = std::chrono::steady_clock::now();
+        if(!outputStream.map)
+            writeFrame(&outputStream, output.data());
+        auto timeE = std::chrono::steady_clock::now();
+        if(vulkanFFTPlan.measure && context.wisdomFileName)
+            saveVulkanFFTWisdom(&context);
+        for(uint32_t i = 0; i < deviceContexts.size(); ++i) {
+            destroyVulkanFFTOutOfCore(&outOfCores[i]);
+            if(i == 0 && context.pipelineCacheFileName)
+                saveVulkanFFTPipelineCache(&context);
+            freeVulkanFFTContext(deviceContexts[i]);
+        }
+        auto timeF = std::chrono::steady_clock::now();
+        if(measureTime) {
+            fprintf(stderr, "Setup: %.3f ms\n", std::chrono::duration_cast<std::chrono::microseconds>(timeB-timeA).count()*0.001);
+            fprintf(stderr, "Input: %.3f ms\n", std::chrono::duration_cast<std::chrono::microseconds>(timeC-timeB).count()*0.001);
+            fprintf(stderr, "Computation (including transfers): %.3f ms\n", std::chrono::duration_cast<std::chrono::microseconds>(timeD-timeC).count()*0.001);
+            fprintf(stderr, "Output: %.3f ms\n", std::chrono::duration_cast<std::chrono::microseconds>(timeE-timeD).count()*0.001);
+            fprintf(stderr, "Teardown: %.3f ms\n", std::chrono::duration_cast<std::chrono::microseconds>(timeF-timeE).count()*0.001);
+        }
+    } else if(!listDevices) {
+        auto timeA = std::chrono::steady_clock::now();
+        if(!contextInitialized)
+            initVulkanFFTContext(&context);
+        if(!createVulkanFFT(&vulkanFFTPlan))
+            abortWithError("In place transforms need rows which fit into shared memory and no Bluestein");
+        if(visualizeOutput)
+            createVulkanFFTVisualization(&visualization);
+        if(vulkanFFTPlan.measure && context.wisdomFileName)
+            saveVulkanFFTWisdom(&context);
         VkCommandBuffer commandBuffer = createCommandBuffer(&context, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
         recordVulkanFFT(&vulkanFFTPlan, commandBuffer);
+        if(visualizeOutput)
+            recordVulkanFFTVisualization(&visualization, commandBuffer);
         vkEndCommandBuffer(commandBuffer);
         auto timeB = std::chrono::steady_clock::now();
         readDataStream(&inputStream, &vulkanFFTPlan);
@@ -394,9 +1421,18 @@ int main(int argc, const char** argv) {
         assert(vkWaitForFences(context.device, 1, &context.fence, VK_TRUE, 100000000000) == VK_SUCCESS);
         assert(vkResetFences(context.device, 1, &context.fence) == VK_SUCCESS);
         auto timeD = std::chrono::steady_clock::now();
-        writeDataStream(&outputStream, &vulkanFFTPlan);
+        if(visualizeOutput)
+            writeVisualization(&outputStream);
+        else
+            writeDataStream(&outputStream, &vulkanFFTPlan);
         auto timeE = std::chrono::steady_clock::now();
+        if(profileFileName)
+            writeProfile(profileFileName, &vulkanFFTPlan);
+        if(visualizeOutput)
+            destroyVulkanFFTVisualization(&visualization);
         destroyVulkanFFT(&vulkanFFTPlan);
+        if(context.pipelineCacheFileName)
+            saveVulkanFFTPipelineCache(&context);
         freeVulkanFFTContext(&context);
         auto timeF = std::chrono::steady_clock::now();
         if(measureTime) {
@@ -408,10 +1444,16 @@ int main(int argc, const char** argv) {
         }
     }
 
-    vkDestroyCommandPool(context.device, context.commandPool, context.allocator);
-    vkDestroyDevice(context.device, NULL);
+    if(!listDevices) {
+        closeDataStream(&inputStream);
+        closeDataStream(&outputStream);
+    }
+    for(VulkanFFTContext* deviceContext : deviceContexts) {
+        vkDestroyCommandPool(deviceContext->device, deviceContext->commandPool, deviceContext->allocator);
+        vkDestroyDevice(deviceContext->device, NULL);
+    }
     #ifndef NDEBUG
-    {
+    if(instance) {
         PFN_vkDestroyDebugUtilsMessengerEXT func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
         assert(func);
         func(instance, debugMessenger, context.allocator);